@@ -29,12 +29,15 @@
  */
 
 #include <sys/types.h>
+#include <string.h>
+#include <err.h>
 
 #include "config.h"
 
 #include <md5.h>
 
 #include "arc4.h"
+#include "md5_multi.h"
 
 /* 
  * An arc4 stream generator is used for encryption and pseudo-random
@@ -124,6 +127,60 @@ arc4_addrandom(struct arc4_stream *as, u_char *dat, int datlen)
 	as->j = j;
 }
 
+/* One step of the key schedule, the indices are kept in registers */
+#define ARC4_KSA(s, i, j, k) do { \
+	u_int8_t si; \
+	(i)++; \
+	si = (s)[(i)]; \
+	(j) += si + (k); \
+	(s)[(i)] = (s)[(j)]; \
+	(s)[(j)] = si; \
+} while (0)
+
+/*
+ * arc4_addrandom for n streams with data of the same length.  The key
+ * schedule is a chain of dependent swaps; running four independent ones
+ * in lockstep keeps the processor busy while one waits.  Missing lanes
+ * work on a scratch copy.
+ */
+
+void
+arc4_addrandom_multi(struct arc4_stream **as, int n, u_char **dat,
+    int datlen)
+{
+	struct arc4_stream scratch, *a[4];
+	u_int8_t i0, i1, i2, i3, j0, j1, j2, j3;
+	u_char *d[4];
+	int k, l, m, ki;
+
+	for (m = 0; m < n; m += 4) {
+		for (l = 0; l < 4; l++) {
+			k = m + l < n ? m + l : n - 1;
+			a[l] = m + l < n ? as[k] : &scratch;
+			d[l] = dat[k];
+		}
+		if (m + 4 > n)
+			scratch = *as[n - 1];
+
+		i0 = a[0]->i - 1; j0 = a[0]->j;
+		i1 = a[1]->i - 1; j1 = a[1]->j;
+		i2 = a[2]->i - 1; j2 = a[2]->j;
+		i3 = a[3]->i - 1; j3 = a[3]->j;
+		for (k = 0, ki = 0; k < 256; k++) {
+			ARC4_KSA(a[0]->s, i0, j0, d[0][ki]);
+			ARC4_KSA(a[1]->s, i1, j1, d[1][ki]);
+			ARC4_KSA(a[2]->s, i2, j2, d[2][ki]);
+			ARC4_KSA(a[3]->s, i3, j3, d[3][ki]);
+			if (++ki >= datlen)
+				ki = 0;
+		}
+		a[0]->i = i0; a[0]->j = j0;
+		a[1]->i = i1; a[1]->j = j1;
+		a[2]->i = i2; a[2]->j = j2;
+		a[3]->i = i3; a[3]->j = j3;
+	}
+}
+
 void
 arc4_initkey(struct arc4_stream *as, u_char *key, int keylen)
 {
@@ -139,15 +196,50 @@ arc4_initkey(struct arc4_stream *as, u_char *key, int keylen)
 	arc4_addrandom(as, digest, 16);
 }
 
+/*
+ * Folds a key into the five bytes that jsteg uses as its real key.
+ * Keys with the same fold produce the same stream.
+ */
+
 void
-arc4_fixedkey(struct arc4_stream *as, u_char *key, int keylen)
+arc4_fold(u_char *digest, u_char *key, int keylen)
 {
-	u_char digest[5];
 	int i;
 
-	memset(digest, 0, sizeof(digest));
+	memset(digest, 0, ARC4_FOLDLEN);
 	for (i = 0; i < keylen; i++)
-		digest[i % 5] ^= key[i];
+		digest[i % ARC4_FOLDLEN] ^= key[i];
+}
+
+/* arc4_initkey for n keys, the digests are computed together */
+
+void
+arc4_initkey_multi(struct arc4_stream *as, int n, u_char **keys,
+    int *keylens)
+{
+	struct arc4_stream *pas[MD5_MULTI_MAX];
+	u_char digest[MD5_MULTI_MAX][16], *pdigest[MD5_MULTI_MAX];
+	int i;
+
+	if (n > MD5_MULTI_MAX)
+		errx(1, "%s: too many keys: %d", __func__, n);
+
+	md5_multi(digest, n, (const u_char **)keys, keylens);
+
+	for (i = 0; i < n; i++) {
+		arc4_init(&as[i]);
+		pas[i] = &as[i];
+		pdigest[i] = digest[i];
+	}
+	arc4_addrandom_multi(pas, n, pdigest, 16);
+}
+
+void
+arc4_fixedkey(struct arc4_stream *as, u_char *key, int keylen)
+{
+	u_char digest[ARC4_FOLDLEN];
+
+	arc4_fold(digest, key, keylen);
 		
 	arc4_init(as); 
 	arc4_addrandom(as, digest, 5);
@@ -155,3 +247,28 @@ arc4_fixedkey(struct arc4_stream *as, u_char *key, int keylen)
 	/* Reset */
 	as->i = as->j = 0;
 }
+
+/* arc4_fixedkey for n keys, the key schedules run together */
+
+void
+arc4_fixedkey_multi(struct arc4_stream *as, int n, u_char **keys,
+    int *keylens)
+{
+	struct arc4_stream *pas[MD5_MULTI_MAX];
+	u_char digest[MD5_MULTI_MAX][ARC4_FOLDLEN], *pdigest[MD5_MULTI_MAX];
+	int i;
+
+	if (n > MD5_MULTI_MAX)
+		errx(1, "%s: too many keys: %d", __func__, n);
+
+	for (i = 0; i < n; i++) {
+		arc4_fold(digest[i], keys[i], keylens[i]);
+		arc4_init(&as[i]);
+		pas[i] = &as[i];
+		pdigest[i] = digest[i];
+	}
+	arc4_addrandom_multi(pas, n, pdigest, ARC4_FOLDLEN);
+
+	for (i = 0; i < n; i++)
+		as[i].i = as[i].j = 0;
+}
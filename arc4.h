@@ -31,6 +31,8 @@
 #ifndef _ARC4_
 #define _ARC4_
 
+#define ARC4_FOLDLEN	5	/* Effective key length of arc4_fixedkey */
+
 struct arc4_stream {
 	u_int8_t i;
 	u_int8_t j;
@@ -38,8 +40,12 @@ struct arc4_stream {
 };
 
 void arc4_addrandom(struct arc4_stream *, u_char *, int);
+void arc4_addrandom_multi(struct arc4_stream **, int, u_char **, int);
 void arc4_initkey(struct arc4_stream *, u_char *, int);
+void arc4_initkey_multi(struct arc4_stream *, int, u_char **, int *);
 void arc4_fixedkey(struct arc4_stream *, u_char *, int);
+void arc4_fixedkey_multi(struct arc4_stream *, int, u_char **, int *);
+void arc4_fold(u_char *, u_char *, int);
 
 void arc4_skipbytes(struct arc4_stream *, int);
 
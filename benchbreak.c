@@ -0,0 +1,609 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Crack-rate micro benchmark for stegbreak.  Builds synthetic targets
+ * through the regular *_prepare functions, plants known-answer positives
+ * with an independent implementation of each embedding, and drives the
+ * crackers over a fixed candidate stream.  Exits non-zero if a planted
+ * positive is missed or a negative cracks.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/queue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <file.h>
+
+#include "config.h"
+#include "common.h"
+#include "arc4.h"
+#include "blowfish.h"
+#include "bf_locl.h"
+#include "break_jphide.h"
+#include "break_outguess.h"
+#include "break_jsteg.h"
+#include "db.h"
+
+#define FLAG_DOOUTGUESS	0x0001
+#define FLAG_DOJPHIDE	0x0002
+#define FLAG_DOJSTEG	0x0004
+
+#define NTIERS		3
+#define DEFAULT_CRACKS	16384
+
+#define JPH_WIDTH	16	/* blocks per row and column */
+#define JPH_BITS	50000
+#define JPH_LENGTH	1000
+
+#define OG_BITS		100000
+#define OG_SEED		1234
+#define OG_LENGTH	512
+
+#define JS_BITS		40000
+#define JS_BYTES	4096
+
+#define PASS_V5		"planted5"
+#define PASS_V3		"planted3"
+#define PASS_OG		"plantedog"
+#define PASS_JS		"plantedjs"
+
+#ifdef WORDS_BIGENDIAN
+#define BLF_ENC(x,y) do { \
+				u_char *tmp; \
+				BF_LONG data[2]; \
+				tmp = (u_char *)&(x)[0]; \
+				c2l(tmp, data[0]); \
+				tmp = (u_char *)&(x)[1]; \
+				c2l(tmp, data[1]); \
+				BF_encrypt(data,y); \
+				tmp = (u_char *)&(x)[0]; \
+				l2c(data[0], tmp); \
+				tmp = (u_char *)&(x)[1]; \
+				l2c(data[1], tmp); \
+			} while (0)
+#else
+#define BLF_ENC(x,y) BF_encrypt(x,y)
+#endif
+
+/* Mirrors break_outguess.c */
+#define INIT_SKIPMOD	32
+#define SKIPADJ(x,y)	((y) > (x)/32 ? 2 : 2 - ((x/32) - (y))/(float)(x/32))
+
+struct target {
+	char name[32];
+	void *obj;
+	char *password;		/* Planted password or NULL */
+	int cracked;		/* Candidate index that cracked it */
+};
+
+struct scheme {
+	int type;
+	char *name;
+	int (*crack)(void *, char *, void *);
+	void (*destroy)(void *);
+	void *(*create)(int, char **);
+	void *(*state_new)(void);
+	void (*state_free)(void *);
+	int (*compare)(void *, void *);
+	int (*crack_group)(void *, char **, int, void *);
+};
+
+int tiers[NTIERS] = { 1, 64, 1024 };
+struct scheme *sort_scheme;
+int noise_state;
+char *progname;
+int quiet = 1;
+
+extern JBLOCKARRAY dctcompbuf[];
+
+int
+noise(void)
+{
+	/* Park-Miller, so that all platforms agree */
+	noise_state = ((u_int64_t)noise_state * 16807) % 2147483647;
+	return (noise_state);
+}
+
+char **
+candidates_make(int n)
+{
+	char **words;
+	int i, j, len;
+
+	if ((words = malloc(n * sizeof(char *))) == NULL)
+		err(1, "malloc");
+
+	noise_state = 31337;
+	for (i = 0; i < n; i++) {
+		len = 4 + noise() % 7;
+		if ((words[i] = malloc(len + 1)) == NULL)
+			err(1, "malloc");
+		for (j = 0; j < len; j++)
+			words[i][j] = 'a' + noise() % 26;
+		words[i][len] = '\0';
+	}
+
+	return (words);
+}
+
+/*
+ * JPHide: the walk starts on the DC coefficients of the first component.
+ * Values outside of [-1, 1] are always used and do not consume PRNG bits,
+ * so the header bits can be planted directly into coefficients 1..128.
+ */
+
+void
+jphide_coeffs(JBLOCKARRAY *comps, int planted)
+{
+	int comp, row, col, i;
+
+	for (comp = 0; comp < 3; comp++) {
+		wib[comp] = hib[comp] = JPH_WIDTH;
+		for (row = 0; row < JPH_WIDTH; row++)
+			for (col = 0; col < JPH_WIDTH; col++)
+				for (i = 0; i < DCTSIZE2; i++) {
+					int val = noise() % 600 - 300;
+					/* Some small values exercise the PRNG */
+					if (!planted && (noise() % 16) == 0)
+						val = noise() % 3 - 1;
+					comps[comp][row][col][i] = val;
+				}
+		dctcompbuf[comp] = comps[comp];
+	}
+}
+
+void
+jphide_plant(JBLOCKARRAY *comps, char *word, int v5)
+{
+	BF_KEY key;
+	u_char iv[8], e[8], e2[8], plain[16], buf[56];
+	int i, j, n, bit, len;
+
+	for (i = 0; i < 8; i++)
+		iv[i] = comps[0][0][0][i];
+
+	len = strlen(word);
+	if (v5) {
+		memcpy(buf, iv, 6);
+		memcpy(buf + 6, word, len);
+		BF_set_key(&key, len + 6, buf);
+	} else
+		BF_set_key(&key, len, (u_char *)word);
+
+	/* The IV is rotated by one byte for each of the four streams */
+	for (i = 0; i < 8; i++)
+		e[i] = iv[(i + 4) % 8];
+	BLF_ENC((BF_LONG *)e, &key);
+	memcpy(e2, e, sizeof(e2));
+	BLF_ENC((BF_LONG *)e2, &key);
+
+	memset(plain, 0, sizeof(plain));
+	plain[0] = (JPH_LENGTH >> 16) & 0xff;
+	plain[1] = (JPH_LENGTH >> 8) & 0xff;
+	plain[2] = JPH_LENGTH & 0xff;
+	if (v5) {
+		memcpy(plain + 5, e + 5, 3);
+		plain[9] = plain[1];
+		plain[10] = plain[2];
+		memcpy(plain + 12, e2 + 4, 4);
+		n = 16;
+	} else {
+		memcpy(plain + 3, e + 3, 5);
+		n = 8;
+	}
+
+	for (i = 0; i < n; i += 8)
+		BLF_ENC((BF_LONG *)(plain + i), &key);
+
+	/* Coefficient 0 protects the IV; bits are read LSB first */
+	for (i = 0; i < n * 8; i++) {
+		JCOEF *c = &comps[0][(i + 1) / JPH_WIDTH][(i + 1) % JPH_WIDTH][0];
+		bit = (plain[i / 8] >> (i % 8)) & 1;
+		j = 2 + (noise() % 100) * 2 + bit;
+		*c = noise() & 1 ? j : -j;
+	}
+}
+
+void *
+jphide_create(int idx, char **ppass)
+{
+	static JBLOCKARRAY comps[3];
+	int comp, row;
+
+	if (comps[0] == NULL) {
+		for (comp = 0; comp < 3; comp++) {
+			comps[comp] = malloc(JPH_WIDTH * sizeof(JBLOCKROW));
+			if (comps[comp] == NULL)
+				err(1, "malloc");
+			for (row = 0; row < JPH_WIDTH; row++) {
+				comps[comp][row] =
+				    malloc(JPH_WIDTH * sizeof(JBLOCK));
+				if (comps[comp][row] == NULL)
+					err(1, "malloc");
+			}
+		}
+	}
+
+	*ppass = NULL;
+	jphide_coeffs(comps, idx < 2);
+	if (idx == 0) {
+		*ppass = PASS_V5;
+		jphide_plant(comps, PASS_V5, 1);
+	} else if (idx == 1) {
+		*ppass = PASS_V3;
+		jphide_plant(comps, PASS_V3, 0);
+	}
+
+	return (break_jphide_prepare(JPH_BITS));
+}
+
+/*
+ * OutGuess: replays the iterator to find the bit positions of the
+ * header and of the encrypted data.
+ */
+
+struct og_iter {
+	struct arc4_stream as;
+	u_int32_t skipmod;
+	int off;
+};
+
+void
+og_iter_init(struct og_iter *iter, struct arc4_stream *as)
+{
+	u_char derive[16];
+	int i;
+
+	iter->skipmod = INIT_SKIPMOD;
+	iter->as = *as;
+	for (i = 0; i < sizeof(derive); i++)
+		derive[i] = arc4_getbyte(&iter->as);
+	arc4_addrandom(&iter->as, derive, sizeof(derive));
+	iter->off = arc4_getword(&iter->as) % iter->skipmod;
+}
+
+int
+og_put_byte(short *dcts, struct og_iter *iter, u_char val)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		if (iter->off >= OG_BITS)
+			return (-1);
+		dcts[iter->off] = (dcts[iter->off] & ~1) | ((val >> i) & 1);
+		iter->off += (arc4_getword(&iter->as) % iter->skipmod) + 1;
+	}
+
+	return (0);
+}
+
+void
+outguess_plant(short *dcts, char *word)
+{
+	struct arc4_stream as, hdr, data;
+	struct og_iter iter;
+	u_char state[4], reseed[2], plain[OG_LENGTH];
+	char *text = "echo stegbreak benchmark\n";
+	int i, length, bits = OG_BITS;
+
+	snprintf((char *)plain, sizeof(plain), "#!/bin/sh\n");
+	for (i = strlen((char *)plain); i < sizeof(plain); i++)
+		plain[i] = text[i % strlen(text)];
+
+	arc4_initkey(&as, (u_char *)word, strlen(word));
+	og_iter_init(&iter, &as);
+	hdr = data = as;
+
+	state[0] = OG_SEED & 0xff;
+	state[1] = OG_SEED >> 8;
+	state[2] = OG_LENGTH & 0xff;
+	state[3] = OG_LENGTH >> 8;
+	for (i = 0; i < 4; i++)
+		if (og_put_byte(dcts, &iter, state[i] ^ arc4_getbyte(&hdr)))
+			errx(1, "%s: header does not fit", __func__);
+
+	reseed[0] = state[0];
+	reseed[1] = state[1];
+	arc4_addrandom(&iter.as, reseed, 2);
+
+	length = OG_LENGTH;
+	for (i = 0; i < length; i++) {
+		iter.skipmod = SKIPADJ(bits, bits - iter.off) *
+		    (bits - iter.off)/(8 * (length - i));
+		if (og_put_byte(dcts, &iter, plain[i] ^ arc4_getbyte(&data)))
+			errx(1, "%s: data does not fit", __func__);
+	}
+}
+
+void *
+outguess_create(int idx, char **ppass)
+{
+	static short *dcts;
+	int i;
+
+	if (dcts == NULL && (dcts = malloc(OG_BITS * sizeof(short))) == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < OG_BITS; i++)
+		dcts[i] = 2 + noise() % 30;
+
+	*ppass = NULL;
+	if (idx == 0) {
+		*ppass = PASS_OG;
+		outguess_plant(dcts, PASS_OG);
+	}
+
+	return (break_outguess_prepare(dcts, OG_BITS));
+}
+
+/*
+ * JSteg: a five bit width and the length precede the data, the last
+ * eight bytes of the data carry the "korejwa" signature.
+ */
+
+void *
+jsteg_create(int idx, char **ppass)
+{
+	static short *dcts;
+	struct arc4_stream as;
+	u_char tail[8];
+	int i, j, off, width, bytes;
+
+	if (dcts == NULL && (dcts = malloc(JS_BITS * sizeof(short))) == NULL)
+		err(1, "malloc");
+
+	/* Even values, so the header is empty and not file magic'ed */
+	for (i = 0; i < JS_BITS; i++)
+		dcts[i] = 2 + (noise() % 15) * 2;
+
+	/* Images differ in size, so does the keystream before the tail */
+	bytes = JS_BYTES / 4 + noise() % (JS_BYTES * 3 / 4);
+	for (width = 0; (bytes >> width) != 0; width++)
+		;
+	for (i = 0; i < 5; i++)
+		dcts[i] = 2 | ((width >> (4 - i)) & 1);
+	for (i = 0; i < width; i++)
+		dcts[5 + i] = 2 | ((bytes >> (width - 1 - i)) & 1);
+	off = 5 + width;
+
+	*ppass = NULL;
+	if (idx == 0) {
+		*ppass = PASS_JS;
+		arc4_fixedkey(&as, (u_char *)PASS_JS, strlen(PASS_JS));
+		arc4_skipbytes(&as, bytes - sizeof(tail));
+		memcpy(tail, "\0korejwa", sizeof(tail));
+		for (i = 0; i < sizeof(tail); i++)
+			tail[i] ^= arc4_getbyte(&as);
+
+		off += (bytes - sizeof(tail)) * 8;
+		for (i = 0; i < sizeof(tail); i++)
+			for (j = 0; j < 8; j++)
+				dcts[off++] = 2 | ((tail[i] >> (7 - j)) & 1);
+	}
+
+	return (break_jsteg_prepare("benchbreak", dcts, JS_BITS));
+}
+
+struct scheme schemes[] = {
+	{ FLAG_DOJPHIDE, "jphide", crack_jphide, break_jphide_destroy,
+	  jphide_create, break_jphide_state_new, break_jphide_state_free,
+	  break_jphide_compare, crack_jphide_group },
+	{ FLAG_DOOUTGUESS, "outguess", crack_outguess, break_outguess_destroy,
+	  outguess_create, break_outguess_state_new,
+	  break_outguess_state_free, NULL, crack_outguess_group },
+	{ FLAG_DOJSTEG, "jsteg", crack_jsteg, break_jsteg_destroy,
+	  jsteg_create, break_jsteg_state_new, break_jsteg_state_free,
+	  break_jsteg_compare, crack_jsteg_group },
+	{ 0, NULL }
+};
+
+int
+target_compare(const void *a, const void *b)
+{
+	const struct target *ta = a, *tb = b;
+
+	return (sort_scheme->compare(ta->obj, tb->obj));
+}
+
+/* Returns the number of failures */
+int
+bench_tier(struct scheme *scheme, int ntargets, int ncracks)
+{
+	struct target *targets;
+	struct timeval start, end, tv;
+	char **words, *passwords[2];
+	void *state;
+	int i, j, k, n, nwords, npass, cracks, errors, left;
+	float msec;
+
+	if ((targets = calloc(ntargets, sizeof(struct target))) == NULL)
+		err(1, "calloc");
+
+	noise_state = 4711;
+	npass = 0;
+	for (i = 0; i < ntargets; i++) {
+		snprintf(targets[i].name, sizeof(targets[i].name),
+		    "%s-%d", scheme->name, i);
+		targets[i].obj = scheme->create(i, &targets[i].password);
+		if (targets[i].obj == NULL)
+			errx(1, "%s: could not create target", targets[i].name);
+		targets[i].cracked = -1;
+		if (targets[i].password != NULL)
+			passwords[npass++] = targets[i].password;
+	}
+
+	/* Sorted like in the stegbreak database */
+	if (scheme->compare != NULL) {
+		sort_scheme = scheme;
+		qsort(targets, ntargets, sizeof(struct target),
+		    target_compare);
+	}
+
+	/* The planted passwords come last, every target is tried */
+	nwords = ncracks / ntargets;
+	if (nwords < npass + 1)
+		nwords = npass + 1;
+	words = candidates_make(nwords);
+	for (i = 0; i < npass; i++) {
+		free(words[nwords - npass + i]);
+		words[nwords - npass + i] = strdup(passwords[i]);
+	}
+
+	state = scheme->state_new();
+	cracks = 0;
+	left = ntargets;
+	gettimeofday(&start, NULL);
+	/* Like the stegbreak database, in groups if the scheme can */
+	for (i = 0; i < nwords && left; i += n) {
+		n = 1;
+		if (scheme->crack_group != NULL)
+			for (; n < DB_GROUP && i + n < nwords; n++)
+				;
+		for (j = 0; j < ntargets; j++) {
+			if (targets[j].cracked != -1)
+				continue;
+			cracks += n;
+			if (scheme->crack_group != NULL)
+				k = scheme->crack_group(state, words + i, n,
+				    targets[j].obj);
+			else
+				k = scheme->crack(state, words[i],
+				    targets[j].obj) ? 0 : -1;
+			if (k != -1) {
+				targets[j].cracked = i + k;
+				left--;
+			}
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	errors = 0;
+	for (i = 0; i < ntargets; i++) {
+		struct target *t = &targets[i];
+		if (t->password == NULL && t->cracked != -1) {
+			fprintf(stderr, "%s: false positive with \"%s\"\n",
+			    t->name, words[t->cracked]);
+			errors++;
+		} else if (t->password != NULL &&
+		    (t->cracked == -1 || strcmp(words[t->cracked], t->password))) {
+			fprintf(stderr, "%s: planted \"%s\" not found\n",
+			    t->name, t->password);
+			errors++;
+		}
+	}
+
+	timersub(&end, &start, &tv);
+	msec = tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+	fprintf(stdout, "%-9s %7d %7d %9d %9.1f %11.1f %s\n",
+	    scheme->name, ntargets, nwords, cracks, msec,
+	    msec > 0 ? cracks * 1000.0 / msec : 0, errors ? "FAIL" : "ok");
+
+	scheme->state_free(state);
+	for (i = 0; i < ntargets; i++)
+		scheme->destroy(targets[i].obj);
+	for (i = 0; i < nwords; i++)
+		free(words[i]);
+	free(words);
+	free(targets);
+
+	return (errors);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "Usage: %s [-n <cracks>] [-t <schemes>]\n", progname);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct scheme *scheme;
+	int ch, i, scans, ncracks, errors;
+
+	progname = argv[0];
+	scans = FLAG_DOJPHIDE | FLAG_DOOUTGUESS | FLAG_DOJSTEG;
+	ncracks = DEFAULT_CRACKS;
+
+	while ((ch = getopt(argc, argv, "n:t:")) != -1)
+		switch((char)ch) {
+		case 'n':
+			if ((ncracks = atoi(optarg)) <= 0) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 't':
+			scans = 0;
+			for (i = 0; i < strlen(optarg); i++)
+				switch(optarg[i]) {
+				case 'o':
+					scans |= FLAG_DOOUTGUESS;
+					break;
+				case 'p':
+					scans |= FLAG_DOJPHIDE;
+					break;
+				case 'j':
+					scans |= FLAG_DOJSTEG;
+					break;
+				default:
+					usage();
+					exit(1);
+				}
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+
+	if (file_init())
+		errx(1, "file magic initializiation failed");
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	fprintf(stdout, "%-9s %7s %7s %9s %9s %11s\n",
+	    "scheme", "images", "words", "cracks", "msec", "c/s");
+	errors = 0;
+	for (scheme = &schemes[0]; scheme->name; scheme++) {
+		if (!(scans & scheme->type))
+			continue;
+		for (i = 0; i < NTIERS; i++)
+			errors += bench_tier(scheme, tiers[i], ncracks);
+	}
+
+	exit(errors != 0);
+}
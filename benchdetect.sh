@@ -0,0 +1,122 @@
+#!/bin/sh
+#
+# Generates a deterministic corpus of JPEG images with the in-tree cjpeg
+# and times stegdetect for each of its tests.  The corpus varies image
+# size, quality, chroma subsampling, restart interval and baseline vs
+# progressive encoding, so that regressions in decoding and in detection
+# show up in the reported images/s and MB/s figures.  Finally, it runs
+# stegdetect many times on the smallest image to time its startup.
+#
+# Usage: benchdetect.sh <cjpeg> <stegdetect> [corpus directory]
+
+CJPEG=${1:-./jpeg-6b/cjpeg}
+STEGDETECT=${2:-./stegdetect}
+CORPUS=${3:-bench-corpus}
+TESTS="j o p i f F a"
+SIZES="256x256 640x480 1024x768"
+QUALITIES="50 75 95"
+SAMPLES="1x1 2x2"
+RESTARTS="0 8"
+MODES="baseline progressive"
+STARTS=100
+
+if [ ! -x "$CJPEG" ]; then
+	echo "$0: $CJPEG: not executable" >&2
+	exit 1
+fi
+if [ ! -x "$STEGDETECT" ]; then
+	echo "$0: $STEGDETECT: not executable" >&2
+	exit 1
+fi
+
+# Portable timestamp in milliseconds; falls back to seconds.
+now() {
+	t=`date +%s%N 2>/dev/null`
+	case "$t" in
+	*N|"")
+		echo `date +%s`000 ;;
+	*)
+		echo `expr $t / 1000000` ;;
+	esac
+}
+
+# Writes a plain PPM with texture, edges and pseudo-random noise.  The
+# noise uses a Park-Miller generator so that every awk produces the
+# same pixels.
+genppm() {
+	awk -v w=$1 -v h=$2 'BEGIN {
+		seed = 4711;
+		printf("P3\n%d %d\n255\n", w, h);
+		for (y = 0; y < h; y++) {
+			for (x = 0; x < w; x++) {
+				seed = (seed * 16807) % 2147483647;
+				n = seed % 24;
+				b = 64 * sin(x / 13.0) * cos(y / 17.0);
+				r = int(x * 255 / w + b + n) % 256;
+				g = int(y * 255 / h - b + n) % 256;
+				v = int((x + y) % 64 * 4 + n / 2) % 256;
+				if (r < 0) r += 256;
+				if (g < 0) g += 256;
+				printf("%d %d %d\n", r, g, v);
+			}
+		}
+	}'
+}
+
+if [ ! -f "$CORPUS/.done" ]; then
+	rm -rf "$CORPUS"
+	mkdir -p "$CORPUS" || exit 1
+	echo "Generating corpus in $CORPUS..." >&2
+	for size in $SIZES; do
+		w=`echo $size | cut -dx -f1`
+		h=`echo $size | cut -dx -f2`
+		genppm $w $h > "$CORPUS/$size.ppm"
+		for q in $QUALITIES; do
+		for s in $SAMPLES; do
+		for r in $RESTARTS; do
+		for m in $MODES; do
+			name="$CORPUS/$size-q$q-s$s-r$r-$m.jpg"
+			opts="-quality $q -sample $s,1x1,1x1 -restart $r"
+			if [ $m = progressive ]; then
+				opts="$opts -progressive"
+			fi
+			$CJPEG $opts "$CORPUS/$size.ppm" > "$name" || exit 1
+		done
+		done
+		done
+		done
+		rm -f "$CORPUS/$size.ppm"
+	done
+	touch "$CORPUS/.done"
+fi
+
+files=`ls "$CORPUS"/*.jpg`
+nfiles=`echo "$files" | wc -l`
+bytes=`cat $files | wc -c`
+
+echo "Corpus: $nfiles images, $bytes bytes"
+printf "%-6s %10s %10s %10s\n" "test" "msec" "images/s" "MB/s"
+for t in $TESTS; do
+	start=`now`
+	$STEGDETECT -t $t $files > /dev/null 2>&1
+	end=`now`
+	awk -v t=$t -v ms=`expr $end - $start` -v n=$nfiles -v b=$bytes \
+	    'BEGIN {
+		s = ms > 0 ? ms / 1000.0 : 0.001;
+		printf("%-6s %10d %10.1f %10.2f\n", t, ms, n / s,
+		    b / s / (1024 * 1024));
+	}'
+done
+
+# Job runners start stegdetect once per batch, so startup matters too.
+small=`ls -S $files | tail -1`
+start=`now`
+i=0
+while [ $i -lt $STARTS ]; do
+	$STEGDETECT -t p "$small" > /dev/null 2>&1
+	i=`expr $i + 1`
+done
+end=`now`
+awk -v ms=`expr $end - $start` -v n=$STARTS 'BEGIN {
+	printf("%-6s %10.2f msec/run\n", "start", ms / n);
+}'
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Sets up several independent Blowfish keys at once.  Each key schedule
+ * is a chain of 521 dependent encryptions, so a single key leaves most
+ * of the processor waiting on S-box loads.  The keys here advance in
+ * lockstep: the portable version interleaves four of them, the AVX2
+ * version computes eight in the lanes of a vector with gathers from
+ * the S-boxes of each key.  The results are identical to BF_set_key.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "config.h"
+#include "blowfish.h"
+#include "bf_locl.h"
+#include "bf_pi.h"
+#include "bf_multi.h"
+
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#define BF_NP		(BF_ROUNDS + 2)
+#define BF_NS		(4 * 256)
+#define BF_LANES	4	/* Interleaved keys in the portable version */
+
+#define BF_F(S, x)	((((S)[(x) >> 24] + \
+			    (S)[0x100 + (((x) >> 16) & 0xff)]) ^ \
+			    (S)[0x200 + (((x) >> 8) & 0xff)]) + \
+			    (S)[0x300 + ((x) & 0xff)])
+
+/* Starts a schedule like BF_set_key: the key is xor'ed into P */
+
+static void
+bf_multi_init(BF_KEY *key, int len, const unsigned char *data)
+{
+	const unsigned char *d, *end;
+	BF_LONG ri;
+	int i, j;
+
+	memcpy(key, &bf_init, sizeof(BF_KEY));
+
+	if (len > BF_NP * 4)
+		len = BF_NP * 4;
+
+	d = data;
+	end = data + len;
+	for (i = 0; i < BF_NP; i++) {
+		ri = 0;
+		for (j = 0; j < 4; j++) {
+			ri = ri << 8 | *d++;
+			if (d >= end)
+				d = data;
+		}
+		key->P[i] ^= ri;
+	}
+}
+
+/*
+ * Runs the schedule of BF_LANES keys.  Lanes past the last key repeat
+ * it; they compute the same values, so their stores do not matter.
+ */
+
+static void
+bf_multi_lanes(BF_KEY *keys, int n)
+{
+	BF_LONG *P[BF_LANES], *S[BF_LANES], l[BF_LANES], r[BF_LANES];
+	int i, j, k;
+
+	for (k = 0; k < BF_LANES; k++) {
+		i = k < n ? k : n - 1;
+		P[k] = keys[i].P;
+		S[k] = keys[i].S;
+		l[k] = r[k] = 0;
+	}
+
+	for (j = 0; j < BF_NP + BF_NS; j += 2) {
+		for (k = 0; k < BF_LANES; k++)
+			l[k] ^= P[k][0];
+		for (i = 1; i <= BF_ROUNDS; i += 2) {
+			for (k = 0; k < BF_LANES; k++)
+				r[k] ^= P[k][i] ^ BF_F(S[k], l[k]);
+			for (k = 0; k < BF_LANES; k++)
+				l[k] ^= P[k][i + 1] ^ BF_F(S[k], r[k]);
+		}
+
+		/* The output halves are swapped and feed the next block */
+		for (k = 0; k < BF_LANES; k++) {
+			BF_LONG t = r[k] ^ P[k][BF_ROUNDS + 1];
+			r[k] = l[k];
+			l[k] = t;
+		}
+
+		/* Only after all lanes have read P[17] */
+		for (k = 0; k < BF_LANES; k++) {
+			if (j < BF_NP) {
+				P[k][j] = l[k];
+				P[k][j + 1] = r[k];
+			} else {
+				S[k][j - BF_NP] = l[k];
+				S[k][j - BF_NP + 1] = r[k];
+			}
+		}
+	}
+}
+
+#ifdef HAVE_AVX2
+#define BF_VECS		2	/* Interleaved vectors, hide gather latency */
+#define BF_VLANES	(8 * BF_VECS)
+
+#define BF_VF(b, x)	_mm256_add_epi32(_mm256_xor_si256(_mm256_add_epi32( \
+	_mm256_i32gather_epi32(s, _mm256_add_epi32(b, \
+	    _mm256_srli_epi32(x, 24)), 4), \
+	_mm256_i32gather_epi32(s + 0x100, _mm256_add_epi32(b, \
+	    _mm256_and_si256(_mm256_srli_epi32(x, 16), ff)), 4)), \
+	_mm256_i32gather_epi32(s + 0x200, _mm256_add_epi32(b, \
+	    _mm256_and_si256(_mm256_srli_epi32(x, 8), ff)), 4)), \
+	_mm256_i32gather_epi32(s + 0x300, _mm256_add_epi32(b, \
+	    _mm256_and_si256(x, ff)), 4))
+
+/*
+ * The same for sixteen keys in the lanes of two vectors.  P lives in
+ * registers, the S-boxes are gathered from the keys themselves, which
+ * are sizeof(BF_KEY) apart.
+ */
+
+__attribute__((target("avx2")))
+static void
+bf_multi_avx2(BF_KEY *keys, int n)
+{
+	__m256i P[BF_NP][BF_VECS], base[BF_VECS], l[BF_VECS], r[BF_VECS];
+	__m256i ff, t;
+	const int *s = (const int *)keys[0].S;
+	int idx[BF_VLANES], i, j, k, v;
+	BF_LONG lo[BF_VLANES], ro[BF_VLANES];
+
+	for (k = 0; k < BF_VLANES; k++)
+		idx[k] = (k < n ? k : n - 1) * (sizeof(BF_KEY) / sizeof(BF_LONG));
+	ff = _mm256_set1_epi32(0xff);
+
+	for (v = 0; v < BF_VECS; v++) {
+		base[v] = _mm256_loadu_si256((__m256i *)(idx + 8 * v));
+		for (i = 0; i < BF_NP; i++)
+			P[i][v] = _mm256_i32gather_epi32(
+			    (const int *)keys[0].P + i, base[v], 4);
+		l[v] = r[v] = _mm256_setzero_si256();
+	}
+
+	for (j = 0; j < BF_NP + BF_NS; j += 2) {
+		for (v = 0; v < BF_VECS; v++)
+			l[v] = _mm256_xor_si256(l[v], P[0][v]);
+		for (i = 1; i <= BF_ROUNDS; i += 2) {
+			for (v = 0; v < BF_VECS; v++)
+				r[v] = _mm256_xor_si256(r[v],
+				    _mm256_xor_si256(P[i][v],
+				    BF_VF(base[v], l[v])));
+			for (v = 0; v < BF_VECS; v++)
+				l[v] = _mm256_xor_si256(l[v],
+				    _mm256_xor_si256(P[i + 1][v],
+				    BF_VF(base[v], r[v])));
+		}
+
+		for (v = 0; v < BF_VECS; v++) {
+			t = _mm256_xor_si256(r[v], P[BF_ROUNDS + 1][v]);
+			r[v] = l[v];
+			l[v] = t;
+		}
+
+		if (j < BF_NP) {
+			for (v = 0; v < BF_VECS; v++) {
+				P[j][v] = l[v];
+				P[j + 1][v] = r[v];
+			}
+			continue;
+		}
+
+		/* There is no scatter in AVX2 */
+		for (v = 0; v < BF_VECS; v++) {
+			_mm256_storeu_si256((__m256i *)(lo + 8 * v), l[v]);
+			_mm256_storeu_si256((__m256i *)(ro + 8 * v), r[v]);
+		}
+		for (k = 0; k < BF_VLANES; k++) {
+			i = k < n ? k : n - 1;
+			keys[i].S[j - BF_NP] = lo[k];
+			keys[i].S[j - BF_NP + 1] = ro[k];
+		}
+	}
+
+	for (i = 0; i < BF_NP; i++) {
+		for (v = 0; v < BF_VECS; v++)
+			_mm256_storeu_si256((__m256i *)(lo + 8 * v), P[i][v]);
+		for (k = 0; k < n && k < BF_VLANES; k++)
+			keys[k].P[i] = lo[k];
+	}
+}
+#endif /* HAVE_AVX2 */
+
+/*
+ * Sets up the n keys in the array keys, key i from lens[i] bytes at
+ * data[i].  The same as calling BF_set_key for each of them.
+ */
+
+void
+BF_set_key_multi(BF_KEY *keys, int n, const int *lens,
+    const unsigned char **data)
+{
+	int i, lanes = BF_LANES;
+
+	for (i = 0; i < n; i++)
+		bf_multi_init(&keys[i], lens[i], data[i]);
+
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		lanes = BF_VLANES;
+#endif
+
+	for (i = 0; i < n; i += lanes) {
+#ifdef HAVE_AVX2
+		if (lanes == BF_VLANES) {
+			bf_multi_avx2(keys + i, n - i);
+			continue;
+		}
+#endif
+		bf_multi_lanes(keys + i, n - i);
+	}
+}
@@ -29,6 +29,7 @@
  */
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -44,27 +45,49 @@
 
 #include "blowfish.h"
 #include "bf_locl.h"
+#include "bf_multi.h"
 #include "break_jphide.h"
 #include "config.h"
 #include "common.h"
-
-int break_jphide_v3(void *, BF_KEY *);
-int break_jphide_v5(void *, BF_KEY *);
+#include "rpp.h"
 
 extern JBLOCKARRAY dctcompbuf[];
 
 typedef u_int32_t blf_block[2];
 
-#define NKSTREAMS 4
-
-BF_KEY *ctx;
-u_int prngn[NKSTREAMS];
-blf_block prngstate[NKSTREAMS];
+#define JPH_KEYLEN	((BF_ROUNDS + 2) * 4)	/* Longest Blowfish key */
+#define JPH_IVLEN	6			/* IV bytes in v5 keys */
+
+/* Per-thread cracking state */
+struct jphstate {
+	BF_KEY *ctx;
+	blf_block prngstate;	/* Only the first code stream is used */
+	u_int64_t kw;		/* Keystream bits, taken from the top */
+	int kn;			/* Number of bits left in kw */
+
+	u_short *walk;
+	int nwalk, where;
+
+	/* Key schedules are kept while the word and IV do not change */
+	u_char iv[8];		/* version 5 marker */
+	u_char oword[57];	/* version 3 marker */
+	BF_KEY ctxv5;
+	BF_KEY ctxv3;
+	int initv5, initv3;
+
+	int version;		/* Version of the last successful crack */
+
+	/* Key schedules of the group of words from crack_jphide_group */
+	int ngroup;
+	char gword[BF_MULTI_MAX][RULE_WORD_SIZE];
+	u_char giv[JPH_IVLEN];
+	int initgv5;
+	BF_KEY gv5[BF_MULTI_MAX];
+	BF_KEY gv3[BF_MULTI_MAX];
+};
 
-int coef, mode, spos;
-int lh, lt, lw, where;
-short *coeff;
-int *lwib, *lhib;
+int break_jphide_v3(struct jphstate *, void *, BF_KEY *);
+int break_jphide_v5(struct jphstate *, void *, BF_KEY *);
 
 #ifdef WORDS_BIGENDIAN
 #define BLF_ENC(x,y) do { \
@@ -100,36 +123,134 @@ int *lwib, *lhib;
 
 #include "jphide_table.h"
 
+#define JPH_NCOEFF	256
+
 struct jphobj {
 	int bits;
 	u_char iv[8];
 	int wib[MAX_COMPS_IN_SCAN];
 	int hib[MAX_COMPS_IN_SCAN];
-	short coeff[256];
+	short coeff[JPH_NCOEFF];
+
+	/* Computed from the above by break_jphide_walk, not stored */
+	int nwalk;
+	u_short walk[JPH_NCOEFF];
+};
+
+#define JPH_DISKSIZE	offsetof(struct jphobj, nwalk)
+
+/*
+ * A walk entry describes a coefficient that may carry data.  The
+ * low bit is the data bit it carries.  With mode < 0, the coefficient
+ * is skipped when the next two code bits are zero.  Otherwise, the
+ * next code bits have to match a pattern of up to four bits: a one if
+ * mode is 3, a zero if |y| <= 1 and another zero if also mode > 0,
+ * a one if mode > 1.  The first mismatch skips the coefficient.
+ */
+#define JPH_BIT		0x0001	/* Data bit of the coefficient */
+#define JPH_NEG		0x0002	/* mode < 0 */
+#define JPH_LEN(w)	(((w) >> 4) & 0x7)	/* Length of the pattern */
+#define JPH_PAT(w)	(((w) >> 8) & 0xf)	/* Pattern, first bit high */
+#define JPH_PEEK	4	/* Code bits needed for one decision */
+
+/* Mask for a pattern of a given length */
+static const u_char jph_mask[JPH_PEEK + 1] = {
+	0x0, 0x8, 0xc, 0xe, 0xf
+};
+
+/* Code bits drawn until the first mismatch */
+static const u_char jph_first[16] = {
+	0, 4, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1
 };
 
+/* Appends an expected code bit to the pattern of a walk entry */
+#define JPH_EXPECT(w, b) do { \
+	(w) |= (b) << (11 - JPH_LEN(w)); \
+	(w) += 1 << 4; \
+} while (0)
+
+/*
+ * Flattens the walk along ltab into the coefficients that are used
+ * independently of the key.  The checks that only depend on the
+ * image are done here, once, instead of for every key.
+ */
+
+void
+break_jphide_walk(struct jphobj *job)
+{
+	int coef, spos, mode, lh, lt, lw;
+	int i, y;
+	u_short w;
+
+	coef = ltab[0];
+	spos = ltab[1];
+	mode = ltab[2];
+	lh = 0;
+	lw = spos - 64;
+	lt = 0;
+
+	job->nwalk = 0;
+	for (i = 0; i < JPH_NCOEFF; i++) {
+		lw += 64;
+		if (lw > job->wib[coef]) {
+			lh++;
+			lw = spos;
+			if (lh >= job->hib[coef]) {
+				lt += 3;
+				if (ltab[lt] < 0)
+					break;
+
+				coef = ltab[lt];
+				lh = 0;
+				lw = spos = ltab[lt + 1];
+				mode = ltab[lt + 2];
+			}
+		}
+
+		/* Protects the IV */
+		if (coef == 0 && lh == 0 && lw <= 7)
+			continue;
+
+		y = job->coeff[i];
+		if (mode < 0) {
+			if (y >= mode && y <= -mode)
+				continue;
+			w = JPH_NEG;
+		} else {
+			w = 0;
+			if (mode == 3)
+				JPH_EXPECT(w, 1);
+			if (y >= -1 && y <= 1) {
+				JPH_EXPECT(w, 0);
+				if (mode)
+					JPH_EXPECT(w, 0);
+			}
+			if (mode > 1)
+				JPH_EXPECT(w, 1);
+		}
+
+		if (y < 0)
+			y = -y;
+		w |= mode < 0 ? (y & 2) >> 1 : y & 1;
+
+		job->walk[job->nwalk++] = w;
+	}
+}
+
 void *
-break_jphide_read(char *filename)
+break_jphide_unpack(char *filename, u_char *buf, size_t len)
 {
 	struct jphobj *job;
-	int fd, i;
+	int i;
 
-	fd = open(filename, O_RDONLY, 0);
-	if (fd == -1) {
-		fprintf(stderr, "%s : error: %s\n",
-			filename, strerror(errno));
+	if (len != JPH_DISKSIZE)
 		return (NULL);
-	}
 
 	job = malloc(sizeof(struct jphobj));
 	if (job == NULL)
 		err(1, "malloc");
 
-	if (read(fd, job, sizeof(*job)) != sizeof(*job)) {
-		close(fd);
-		free(job);
-		return (NULL);
-	}
+	memcpy(job, buf, JPH_DISKSIZE);
 
 	job->bits = ntohl(job->bits);
 
@@ -141,20 +262,38 @@ break_jphide_read(char *filename)
 	for (i = 0; i < sizeof(job->coeff)/sizeof(short); i++)
 		job->coeff[i] = ntohs(job->coeff[i]);
 
-	close(fd);
+	break_jphide_walk(job);
 
 	return (job);
 }
 
-int
-break_jphide_write(char *filename, void *arg)
+void *
+break_jphide_read(char *filename)
 {
-	struct jphobj *job = arg;
-	int fd, i;
+	u_char buf[JPH_DISKSIZE];
+	ssize_t n;
+	int fd;
 
-	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-	if (fd == -1)
-		return (-1);
+	fd = open(filename, O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, "%s : error: %s\n",
+			filename, strerror(errno));
+		return (NULL);
+	}
+
+	n = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (n == -1)
+		return (NULL);
+
+	return (break_jphide_unpack(filename, buf, n));
+}
+
+size_t
+break_jphide_pack(void *arg)
+{
+	struct jphobj *job = arg;
+	int i;
 
 	job->bits = htonl(job->bits);
 
@@ -166,103 +305,87 @@ break_jphide_write(char *filename, void *arg)
 	for (i = 0; i < sizeof(job->coeff)/sizeof(short); i++)
 		job->coeff[i] = htons(job->coeff[i]);
 
-	if (write(fd, job, sizeof(*job)) != sizeof(*job)) {
-		close(fd);
-		return (-1);
-	}
+	return (JPH_DISKSIZE);
+}
 
-	close(fd);
+/* Refills kw with the next 64 bits of the code stream */
 
-	return (0);
+void
+get_code_word(struct jphstate *st)
+{
+	u_char *p = (u_char *)st->prngstate;
+
+	BLF_ENC(st->prngstate, st->ctx);
+
+	st->kw = (u_int64_t)p[0] << 56 | (u_int64_t)p[1] << 48 |
+	    (u_int64_t)p[2] << 40 | (u_int64_t)p[3] << 32 |
+	    (u_int64_t)p[4] << 24 | (u_int64_t)p[5] << 16 |
+	    (u_int64_t)p[6] << 8 | (u_int64_t)p[7];
+	st->kn = 64;
 }
 
 u_char
-get_code_bit(int k)
+get_code_bit(struct jphstate *st)
 {
-	u_int8_t a;
-	u_int32_t n;
+	u_char a;
 
-	if ((n = prngn[k]++ & 0x3f) == 0)
-		BLF_ENC(prngstate[k], ctx);
+	if (st->kn == 0)
+		get_code_word(st);
 
-	a = ((u_char *)(prngstate[k]))[n >> 3] << (n & 0x07);
+	a = st->kw >> 63;
+	st->kw <<= 1;
+	st->kn--;
 
-	return (a & 0x80 ? 1 : 0);
+	return (a);
 }
 
+/*
+ * Returns the next data bit.  The decision for each coefficient is
+ * made on the next four code bits at once, only when fewer are left
+ * in the current word are they drawn one at a time.
+ */
+
 int
-get_word(int *value)
+get_bit(struct jphstate *st)
 {
-	int y;
-
-	while (1) {
-		lw += 64;
-		if (lw > lwib[coef]) {
-			lh++;
-			lw = spos;
-			if (lh >= lhib[coef]) {
-				lt += 3;
-				if (ltab[lt] < 0) {
-					return (1);
-				}
-
-				coef = ltab[lt];
-				lh = 0;
-				lw = spos = ltab[lt + 1];
-				mode = ltab[lt + 2];
-			}
-		} 
-		
-		y = coeff[where++];
+	u_int w, peek, miss;
+	int i, n;
 
-		if (coef == 0 && lh == 0 && (lw <= 7))
-			continue;
+	while (st->where < st->nwalk) {
+		w = st->walk[st->where++];
 
-		if (mode < 0) {
-			if ((y >= mode) && (y <= -mode))
-				continue;
-
-			if (!get_code_bit(0) && !get_code_bit(0))
-				continue;
-		} else {
-			if (mode == 3 && !get_code_bit(0))
-				continue;
-
-			if ((y >= -1) && (y <= 1)) {
-				if (get_code_bit(0))
+		if (st->kn < JPH_PEEK) {
+			if (w & JPH_NEG) {
+				if (!get_code_bit(st) && !get_code_bit(st))
 					continue;
-
-				if (mode && get_code_bit(0))
+			} else {
+				n = JPH_LEN(w);
+				for (i = 0; i < n; i++)
+					if (get_code_bit(st) !=
+					    ((JPH_PAT(w) >> (3 - i)) & 1))
+						break;
+				if (i < n)
 					continue;
 			}
+			return (w & JPH_BIT);
+		}
 
-			if (mode > 1 && !get_code_bit(0))
-				continue;
+		peek = st->kw >> (64 - JPH_PEEK);
+		if (w & JPH_NEG) {
+			n = peek & 0x8 ? 1 : 2;
+			miss = !(peek & 0xc);
+		} else {
+			miss = (peek ^ JPH_PAT(w)) & jph_mask[JPH_LEN(w)];
+			n = miss ? jph_first[miss] : JPH_LEN(w);
 		}
+		st->kw <<= n;
+		st->kn -= n;
 
-		*value = y;
-		return (0);
+		if (!miss)
+			return (w & JPH_BIT);
 	}
-}
-
-int
-get_bit(void)
-{
-	int y;
 
-	if (get_word(&y))
-		return (-1);
-
-	if (y < 0)
-		y = 0 - y;
-
-	if (mode < 0) {
-		y &= 2;
-		y >>= 1;
-	} else
-		y &= 1;
-
-	return (y);
+	return (-1);
 }
 
 void
@@ -271,6 +394,12 @@ break_jphide_destroy(void *obj)
 	free(obj);
 }
 
+size_t
+break_jphide_size(void *obj)
+{
+	return (sizeof(struct jphobj));
+}
+
 int
 break_jphide_compare(void *obj1, void *obj2)
 {
@@ -284,11 +413,12 @@ void *
 break_jphide_prepare(int bits)
 {
 	struct jphobj *job;
+	int coef, spos, lh, lt, lw;
 	int i;
 
-	job = malloc(sizeof(struct jphobj));
+	job = calloc(1, sizeof(struct jphobj));
 	if (job == NULL)
-		err(1, "malloc");
+		err(1, "calloc");
 
 	job->bits = bits;
 	for (i = 0; i < 3; i++) {
@@ -324,91 +454,180 @@ break_jphide_prepare(int bits)
 		job->coeff[i] = dctcompbuf[coef][lh][lw / 64][lw % 64];
 	}
 
+	break_jphide_walk(job);
+
 	return (job);
 }
 
+void *
+break_jphide_state_new(void)
+{
+	struct jphstate *st;
+
+	if ((st = calloc(1, sizeof(struct jphstate))) == NULL)
+		err(1, "calloc");
+
+	return (st);
+}
+
+void
+break_jphide_state_free(void *arg)
+{
+	free(arg);
+}
+
+/* The v5 key is the IV followed by the word, Blowfish uses 72 bytes */
+
+int
+break_jphide_v5key(u_char *key, u_char *iv, char *word)
+{
+	int len;
+
+	len = strlen(word);
+	if (len > JPH_KEYLEN - JPH_IVLEN)
+		len = JPH_KEYLEN - JPH_IVLEN;
+	memcpy(key, iv, JPH_IVLEN);
+	memcpy(key + JPH_IVLEN, word, len);
+
+	return (JPH_IVLEN + len);
+}
+
 int
-crack_jphide(char *filename, char *word, void *obj)
+crack_jphide(void *arg, char *word, void *obj)
 {
-	static u_char iv[8];		/* version 5 marker */
-	static u_char oword[57];	/* version 3 marker */
-	static BF_KEY ctxv5;
-	static BF_KEY ctxv3;
-	static int initv5, initv3;
+	struct jphstate *st = arg;
 	struct jphobj *job = obj;
 	int changed = 0;
 
-	if (strcmp(word, oword)) {
-		strlcpy(oword, word, sizeof(oword));
+	if (strcmp(word, st->oword)) {
+		strlcpy(st->oword, word, sizeof(st->oword));
 		changed = 1;
-		initv3 = 0;
+		st->initv3 = 0;
 	}
 
-	if (!initv5 || changed || memcmp(iv, job->iv, 6)) {
-		u_char key[56];
+	if (!st->initv5 || changed || memcmp(st->iv, job->iv, 6)) {
+		u_char key[JPH_KEYLEN];
+		int len;
 
-		memcpy(iv, job->iv, sizeof(iv));
-		memcpy(key, job->iv, 6);
-		memcpy(key + 6, word, strlen(word));
+		memcpy(st->iv, job->iv, sizeof(st->iv));
+		len = break_jphide_v5key(key, job->iv, word);
 
-		BF_set_key(&ctxv5, strlen(word) + 6, key);
+		BF_set_key(&st->ctxv5, len, key);
 
-		initv5 = 1;
+		st->initv5 = 1;
 	}
 
-	if (break_jphide_v5(job, &ctxv5)) {
-		fprintf(stdout, "%s : jphide[v5](%s)\n",
-			filename, word);
+	if (break_jphide_v5(st, job, &st->ctxv5)) {
+		st->version = 5;
 		return (1);
 	}
 
-	if (!initv3 || changed) {
-		BF_set_key(&ctxv3, strlen(word), word);
+	if (!st->initv3 || changed) {
+		BF_set_key(&st->ctxv3, strlen(word), word);
 		
-		initv3 = 1;
+		st->initv3 = 1;
 	}
 
-	if (break_jphide_v3(job, &ctxv3)) {
-		fprintf(stdout, "%s : jphide[v3](%s)\n",
-			filename, word);
+	if (break_jphide_v3(st, job, &st->ctxv3)) {
+		st->version = 3;
 		return (1);
 	}
 
 	return (0);
 }
 
-void
-break_jphide_setup(u_char *iv, struct jphobj *job, BF_KEY *inctx)
-{
-	int i;
+/*
+ * Tries a group of words.  Their key schedules are set up together,
+ * the v3 keys once for the group and the v5 keys whenever the IV
+ * changes; the images are sorted by IV.
+ */
 
-	ctx = inctx;
-	memcpy(iv, job->iv, sizeof(job->iv));
+int
+crack_jphide_group(void *arg, char **words, int n, void *obj)
+{
+	struct jphstate *st = arg;
+	struct jphobj *job = obj;
+	u_char keys[BF_MULTI_MAX][JPH_KEYLEN];
+	const u_char *data[BF_MULTI_MAX];
+	int i, lens[BF_MULTI_MAX];
+
+	if (n < 1 || n > BF_MULTI_MAX)
+		errx(1, "%s: bad number of words: %d", __func__, n);
+
+	for (i = 0; i < n && i < st->ngroup; i++)
+		if (strcmp(words[i], st->gword[i]))
+			break;
+	if (i < n || n != st->ngroup) {
+		for (i = 0; i < n; i++) {
+			strlcpy(st->gword[i], words[i], sizeof(st->gword[i]));
+			lens[i] = strlen(words[i]);
+			data[i] = (u_char *)words[i];
+		}
+		BF_set_key_multi(st->gv3, n, lens, data);
+		st->ngroup = n;
+		st->initgv5 = 0;
+	}
 
-	memset(prngn, 0, sizeof(prngn));
-	for (i = 0; i < NKSTREAMS; i++) {
-		memcpy(prngstate + i, iv, 8);
-		BLF_ENC(prngstate[i], ctx);
+	if (!st->initgv5 || memcmp(st->giv, job->iv, JPH_IVLEN)) {
+		for (i = 0; i < n; i++) {
+			lens[i] = break_jphide_v5key(keys[i], job->iv,
+			    st->gword[i]);
+			data[i] = keys[i];
+		}
+		BF_set_key_multi(st->gv5, n, lens, data);
+		memcpy(st->giv, job->iv, JPH_IVLEN);
+		st->initgv5 = 1;
+	}
 
-		iv[8] = iv[0]; 
-		memmove(iv, iv + 1, 8);
+	for (i = 0; i < n; i++) {
+		if (break_jphide_v5(st, job, &st->gv5[i])) {
+			st->version = 5;
+			return (i);
+		}
+		if (break_jphide_v3(st, job, &st->gv3[i])) {
+			st->version = 3;
+			return (i);
+		}
 	}
 
-	coef = ltab [0];
-	spos = ltab [1];
-	mode = ltab [2];
-	lh = 0;
-	lw = spos - 64;
-	lt = 0;
+	return (-1);
+}
+
+void
+crack_jphide_report(void *arg, char *filename, char *word, void *obj)
+{
+	struct jphstate *st = arg;
+
+	fprintf(stdout, "%s : jphide[v%d](%s)\n",
+	    filename, st->version, word);
+}
 
-	lwib = job->wib;
-	lhib = job->hib;
-	coeff = job->coeff;
-	where = 0;
+void
+break_jphide_setup(struct jphstate *st, u_char *iv, struct jphobj *job,
+    BF_KEY *inctx)
+{
+	st->ctx = inctx;
+
+	memcpy(st->prngstate, job->iv, 8);
+	BLF_ENC(st->prngstate, st->ctx);
+	st->kn = 0;
+
+	/*
+	 * jphide seeds four code streams from the IV rotated by one
+	 * byte each time, only the first stream selects coefficients.
+	 * The IV is left rotated by four bytes.
+	 */
+	memcpy(iv, job->iv + 4, 4);
+	memcpy(iv + 4, job->iv, 4);
+	iv[8] = job->iv[3];
+
+	st->walk = job->walk;
+	st->nwalk = job->nwalk;
+	st->where = 0;
 }
 
 int
-break_jphide_getbytes(u_char *data, size_t len)
+break_jphide_getbytes(struct jphstate *st, u_char *data, size_t len)
 {
 	int i, j, b;
 	u_char v;
@@ -416,7 +635,7 @@ break_jphide_getbytes(u_char *data, size_t len)
 	for (i = 0; i < len; i++) {
 		v = 0;
 		for (j = 0; j < 8; j++) {
-			if ((b = get_bit()) < 0)
+			if ((b = get_bit(st)) < 0)
 				return (-1);
 
 			b = b << j;
@@ -429,19 +648,19 @@ break_jphide_getbytes(u_char *data, size_t len)
 }
 
 int
-break_jphide_v3 (void *obj, BF_KEY *inctx)
+break_jphide_v3 (struct jphstate *st, void *obj, BF_KEY *inctx)
 {
 	blf_block lendata;
 	struct jphobj *job = obj;
 	int i, len0, len1, len2, length;
 	u_char iv[9];
 
-	break_jphide_setup(iv, job, inctx);
+	break_jphide_setup(st, iv, job, inctx);
 
-	if (break_jphide_getbytes((u_char *)lendata, 8) == -1)
+	if (break_jphide_getbytes(st, (u_char *)lendata, 8) == -1)
 		return (0);
 
-	BLF_DEC(lendata, ctx);
+	BLF_DEC(lendata, st->ctx);
 
 	len0 = ((u_char *)lendata)[0];
 	len1 = ((u_char *)lendata)[1];
@@ -453,7 +672,7 @@ break_jphide_v3 (void *obj, BF_KEY *inctx)
 		return (0);
 
 	/* Encrypt IV for comparison with decryption */
-	BLF_ENC((u_int32_t *)iv, ctx);
+	BLF_ENC((u_int32_t *)iv, st->ctx);
 
 	for (i = 3; i < 8; i++)
 		if (((u_char *)lendata)[i] != iv[i])
@@ -463,7 +682,7 @@ break_jphide_v3 (void *obj, BF_KEY *inctx)
 }
 
 int
-break_jphide_v5 (void *obj, BF_KEY *inctx)
+break_jphide_v5 (struct jphstate *st, void *obj, BF_KEY *inctx)
 {
 	blf_block lendata[2];
 	struct jphobj *job = obj;
@@ -471,12 +690,12 @@ break_jphide_v5 (void *obj, BF_KEY *inctx)
 	int rlen0, rlen1, rlen2, rlength;
 	u_char iv[9], iv2[8], *p;
 
-	break_jphide_setup(iv, job, inctx);
+	break_jphide_setup(st, iv, job, inctx);
 
-	if (break_jphide_getbytes((u_char *)lendata, 8) == -1)
+	if (break_jphide_getbytes(st, (u_char *)lendata, 8) == -1)
 		return (0);
 
-	BLF_DEC(lendata[0], ctx);
+	BLF_DEC(lendata[0], st->ctx);
 	if (((u_char *)lendata)[3] > 3)
 		return (0);
 
@@ -489,17 +708,17 @@ break_jphide_v5 (void *obj, BF_KEY *inctx)
 	if (length * 8 >= job->bits)
 		return (0);
 
-	BLF_ENC((u_int32_t *)iv, ctx);
+	BLF_ENC((u_int32_t *)iv, st->ctx);
 
 	p = (u_char *)lendata;
 
 	if (memcmp(iv + 5, p + 5, 3))
 		return (0);
 
-	if (break_jphide_getbytes((u_char *)lendata[1], 8) == -1)
+	if (break_jphide_getbytes(st, (u_char *)lendata[1], 8) == -1)
 		return (0);
 
-	BLF_DEC(lendata[1], ctx);
+	BLF_DEC(lendata[1], st->ctx);
 
 	if (((u_char *)lendata)[9] != len1 ||
 	    ((u_char *)lendata)[10] != len2)
@@ -514,7 +733,7 @@ break_jphide_v5 (void *obj, BF_KEY *inctx)
 		return (0);
 
 	memcpy(iv2, iv, sizeof(iv2));
-	BLF_ENC((u_int32_t *)iv2, ctx);
+	BLF_ENC((u_int32_t *)iv2, st->ctx);
 
 	if (memcmp(iv2 + 4, p + 12, 4))
 		return (0);
@@ -34,9 +34,15 @@
 int break_jphide_compare(void *, void *);
 void *break_jphide_prepare(int);
 void break_jphide_destroy(void *);
-int crack_jphide(char *, char *, void *);
+size_t break_jphide_size(void *);
+void *break_jphide_state_new(void);
+void break_jphide_state_free(void *);
+int crack_jphide(void *, char *, void *);
+int crack_jphide_group(void *, char **, int, void *);
+void crack_jphide_report(void *, char *, char *, void *);
 
 void *break_jphide_read(char *);
-int break_jphide_write(char *, void *);
+void *break_jphide_unpack(char *, u_char *, size_t);
+size_t break_jphide_pack(void *);
 
 #endif /* _BREAK_JPHIDE_ */
@@ -29,6 +29,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/queue.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -37,6 +38,7 @@
 #include <md5.h>
 #include <errno.h>
 #include <unistd.h>
+#include <ctype.h>
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -48,6 +50,8 @@
 #include "common.h"
 #include "arc4.h"
 #include "break_jsteg.h"
+#include "db.h"
+#include "rpp.h"
 
 #ifndef MIN
 #define		MIN(a,b) (((a)<(b))?(a):(b))
@@ -62,13 +66,33 @@ struct jstegobj {
 	u_int8_t header[JSTEGHEADER];
 };
 
+/*
+ * Per-thread cracking state.  The images are sorted by skip, so for
+ * one word the stream in cur only moves forward; it has been advanced
+ * by pos bytes from the key schedule in as.
+ */
+struct jstegstate {
+	u_char oword[57];
+	int init;
+	struct arc4_stream as;
+	struct arc4_stream cur;
+	int pos;
+
+	/* The same for each word of the group from crack_jsteg_group */
+	int ngroup;
+	char gword[DB_GROUP][RULE_WORD_SIZE];
+	struct arc4_stream gas[DB_GROUP];
+	struct arc4_stream gcur[DB_GROUP];
+	int gpos[DB_GROUP];
+};
+
 int break_jsteg(struct jstegobj *, struct arc4_stream *);
 
 int break_jsteg_filetest(char *filename, struct jstegobj *obj)
 {
 	extern int noprint;
 
-	if (file_process(obj->header, sizeof(obj->header)) == 0)
+	if (file_plausible_text(obj->header, sizeof(obj->header)) == 0)
 		return (0);
 
 	fprintf(stdout, "%s : jsteg[", filename);
@@ -81,60 +105,63 @@ int break_jsteg_filetest(char *filename, struct jstegobj *obj)
 }
 
 void *
-break_jsteg_read(char *filename)
+break_jsteg_unpack(char *filename, u_char *buf, size_t len)
 {
 	struct jstegobj *jstegob;
-	int fd, size;
 
-	fd = open(filename, O_RDONLY, 0);
-	if (fd == -1) {
-		fprintf(stderr, "%s : error: %s\n",
-			filename, strerror(errno));
+	/* Supports old size, too */
+	if (len != sizeof(*jstegob) && len != sizeof(int) + JSTEGBYTES)
 		return (NULL);
-	}
 
 	jstegob = malloc(sizeof(struct jstegobj));
 	if (jstegob == NULL)
 		err(1, "malloc");
 
-	size = read(fd, jstegob, sizeof(*jstegob));
-	/* Supports old size, too */
-	if (size != sizeof(*jstegob) && size != sizeof(int) + JSTEGBYTES) {
-		close(fd);
-		free(jstegob);
-		return (NULL);
-	}
+	memcpy(jstegob, buf, len);
 
 	jstegob->skip = ntohl(jstegob->skip);
 
-	close(fd);
+	if (jstegob->skip < 0) {
+		free(jstegob);
+		return (NULL);
+	}
 
-	if (size == sizeof(*jstegob))
+	if (len == sizeof(*jstegob))
 		break_jsteg_filetest(filename, jstegob);
 
 	return (jstegob);
 }
 
-int
-break_jsteg_write(char *filename, void *arg)
+void *
+break_jsteg_read(char *filename)
 {
-	struct jstegobj *jstegob = arg;
+	u_char buf[sizeof(struct jstegobj)];
+	ssize_t n;
 	int fd;
 
-	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-	if (fd == -1)
-		return (-1);
-
-	jstegob->skip = htonl(jstegob->skip);
-
-	if (write(fd, jstegob, sizeof(*jstegob)) != sizeof(*jstegob)) {
-		close(fd);
-		return (-1);
+	fd = open(filename, O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, "%s : error: %s\n",
+			filename, strerror(errno));
+		return (NULL);
 	}
 
+	n = read(fd, buf, sizeof(buf));
 	close(fd);
+	if (n == -1)
+		return (NULL);
 
-	return (0);
+	return (break_jsteg_unpack(filename, buf, n));
+}
+
+size_t
+break_jsteg_pack(void *arg)
+{
+	struct jstegobj *jstegob = arg;
+
+	jstegob->skip = htonl(jstegob->skip);
+
+	return (sizeof(*jstegob));
 }
 
 void
@@ -143,6 +170,23 @@ break_jsteg_destroy(void *obj)
 	free(obj);
 }
 
+size_t
+break_jsteg_size(void *obj)
+{
+	return (sizeof(struct jstegobj));
+}
+
+/* Orders the images by the keystream that precedes their signature */
+
+int
+break_jsteg_compare(void *obj1, void *obj2)
+{
+	struct jstegobj *js1 = obj1;
+	struct jstegobj *js2 = obj2;
+
+	return (js1->skip - js2->skip);
+}
+
 void *
 break_jsteg_prepare(char *filename, short *dcts, int bits)
 {
@@ -197,63 +241,205 @@ break_jsteg_prepare(char *filename, short *dcts, int bits)
 	return (jstegob);
 }
 
+void *
+break_jsteg_state_new(void)
+{
+	struct jstegstate *st;
+
+	if ((st = calloc(1, sizeof(struct jstegstate))) == NULL)
+		err(1, "calloc");
+
+	return (st);
+}
+
+void
+break_jsteg_state_free(void *arg)
+{
+	free(arg);
+}
+
 int
-crack_jsteg(char *filename, char *word, void *obj)
+crack_jsteg(void *arg, char *word, void *obj)
 {
-	static u_char oword[57];
-	static int init;
-	static struct arc4_stream as;
-	
+	struct jstegstate *st = arg;
 	struct arc4_stream tas;
 	struct jstegobj *jstegob = obj;
 	int changed = 0;
 
-	if (strcmp(word, oword)) {
-		strlcpy(oword, word, sizeof(oword));
+	if (strcmp(word, st->oword)) {
+		strlcpy(st->oword, word, sizeof(st->oword));
 		changed = 1;
-		init = 0;
+		st->init = 0;
 	}
 
-	if (!init || changed) {
-		arc4_fixedkey(&as, word, strlen(word));
-		init = 1;
+	if (!st->init || changed) {
+		arc4_fixedkey(&st->as, word, strlen(word));
+		st->init = 1;
+		st->cur = st->as;
+		st->pos = 0;
 	}
 
-	tas = as;
-	if (break_jsteg(jstegob, &tas)) {
-		extern int noprint;
-		int i;
-		u_int8_t header[JSTEGHEADER];
+	/* Only out of order images have to start from the beginning */
+	if (jstegob->skip < st->pos) {
+		st->cur = st->as;
+		st->pos = 0;
+	}
+	arc4_skipbytes(&st->cur, jstegob->skip - st->pos);
+	st->pos = jstegob->skip;
 
-		fprintf(stdout, "%s : jsteg(%s)", filename, word);
+	tas = st->cur;
+	return (break_jsteg(jstegob, &tas));
+}
 
-		/* Check if we have a header.  Try to file magic it */
-		for (i = 0; i < JSTEGHEADER; i++)
-			if (jstegob->header[i])
-				break;
-		if (i >= JSTEGHEADER)
-			goto out;
-
-		tas = as;
-		for (i = 0; i < JSTEGHEADER; i++)
-			header[i] = jstegob->header[i] ^ arc4_getbyte(&tas);
-		if (file_process(header, JSTEGHEADER) == 0)
-			goto out;
-
-		fprintf(stdout, "[");
-		noprint = 0;
-		file_process(header, JSTEGHEADER);
-		noprint = 1;
-		fprintf(stdout, "]");
-
-		out:
-		fprintf(stdout, "\n");
-		return (1);
+/*
+ * Tries a group of words.  Every word keeps its own stream, so that
+ * an image is read once for the whole group while the streams still
+ * only move forward over the images.
+ */
+
+int
+crack_jsteg_group(void *arg, char **words, int n, void *obj)
+{
+	struct jstegstate *st = arg;
+	struct jstegobj *jstegob = obj;
+	struct arc4_stream tas;
+	u_char *keys[DB_GROUP];
+	int i, lens[DB_GROUP];
+
+	if (n > DB_GROUP)
+		errx(1, "%s: too many words: %d", __func__, n);
+
+	for (i = 0; i < n && i < st->ngroup; i++)
+		if (strcmp(words[i], st->gword[i]))
+			break;
+	if (i < n || n != st->ngroup) {
+		for (i = 0; i < n; i++) {
+			strlcpy(st->gword[i], words[i], sizeof(st->gword[i]));
+			keys[i] = (u_char *)words[i];
+			lens[i] = strlen(words[i]);
+		}
+		arc4_fixedkey_multi(st->gas, n, keys, lens);
+		for (i = 0; i < n; i++) {
+			st->gcur[i] = st->gas[i];
+			st->gpos[i] = 0;
+		}
+		st->ngroup = n;
 	}
 
-	return (0);
+	for (i = 0; i < n; i++) {
+		if (jstegob->skip < st->gpos[i]) {
+			st->gcur[i] = st->gas[i];
+			st->gpos[i] = 0;
+		}
+		arc4_skipbytes(&st->gcur[i], jstegob->skip - st->gpos[i]);
+		st->gpos[i] = jstegob->skip;
+
+		tas = st->gcur[i];
+		if (break_jsteg(jstegob, &tas)) {
+			/* For crack_jsteg_report */
+			st->as = st->gas[i];
+			st->init = 0;
+			return (i);
+		}
+	}
+
+	return (-1);
+}
+
+/*
+ * Words with the same fold are the same jsteg key, so the database
+ * cracks only one of them.  The class is the fold plus one.
+ */
+
+u_int64_t
+break_jsteg_keyclass(char *word)
+{
+	u_char digest[ARC4_FOLDLEN];
+	u_int64_t class = 0;
+	int i;
+
+	arc4_fold(digest, (u_char *)word, strlen(word));
+	for (i = 0; i < ARC4_FOLDLEN; i++)
+		class = class << 8 | digest[i];
+
+	return (class + 1);
 }
 
+/*
+ * Creates a word that folds to the given key.  Every byte of the key
+ * is split into two non-zero bytes, so that the word is a string.
+ */
+
+void
+break_jsteg_keyword(u_int64_t key, char *word)
+{
+	u_char d;
+	int i;
+
+	for (i = ARC4_FOLDLEN - 1; i >= 0; i--, key >>= 8) {
+		d = key & 0xff;
+		if (d == 0) {
+			word[i] = word[i + ARC4_FOLDLEN] = 0x01;
+		} else if (d == 0x01) {
+			word[i] = 0x03;
+			word[i + ARC4_FOLDLEN] = 0x02;
+		} else {
+			word[i] = d ^ 0x01;
+			word[i + ARC4_FOLDLEN] = 0x01;
+		}
+	}
+	word[2 * ARC4_FOLDLEN] = '\0';
+}
+
+/*
+ * Called with db_lock held, right after a successful crack_jsteg or
+ * crack_jsteg_group.
+ */
+void
+crack_jsteg_report(void *arg, char *filename, char *word, void *obj)
+{
+	struct jstegstate *st = arg;
+	struct jstegobj *jstegob = obj;
+	struct arc4_stream tas;
+	extern int noprint;
+	int i;
+	u_int8_t header[JSTEGHEADER];
+
+	/* Words from the key space are shown as their key */
+	for (i = 0; word[i]; i++)
+		if (!isprint((u_char)word[i]))
+			break;
+	if (word[i])
+		fprintf(stdout, "%s : jsteg(key %010llx)", filename,
+		    (unsigned long long)break_jsteg_keyclass(word) - 1);
+	else
+		fprintf(stdout, "%s : jsteg(%s)", filename, word);
+
+	/* Check if we have a header.  Try to file magic it */
+	for (i = 0; i < JSTEGHEADER; i++)
+		if (jstegob->header[i])
+			break;
+	if (i >= JSTEGHEADER)
+		goto out;
+
+	tas = st->as;
+	for (i = 0; i < JSTEGHEADER; i++)
+		header[i] = jstegob->header[i] ^ arc4_getbyte(&tas);
+	if (file_plausible_text(header, JSTEGHEADER) == 0)
+		goto out;
+
+	fprintf(stdout, "[");
+	noprint = 0;
+	file_process(header, JSTEGHEADER);
+	noprint = 1;
+	fprintf(stdout, "]");
+
+ out:
+	fprintf(stdout, "\n");
+}
+
+/* The stream has already been advanced by the skip of the image */
+
 int
 break_jsteg(struct jstegobj *js, struct arc4_stream *as)
 {
@@ -261,8 +447,6 @@ break_jsteg(struct jstegobj *js, struct arc4_stream *as)
 	u_char *p;
 	int i;
 
-	arc4_skipbytes(as, js->skip);
-
 	p = js->coeff;
 	for (i = 0; i < sizeof(js->coeff); i++)
 		plain[i] = p[i] ^ arc4_getbyte(as);
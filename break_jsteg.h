@@ -33,9 +33,18 @@
 
 void *break_jsteg_prepare(char *, short *, int);
 void break_jsteg_destroy(void *);
-int crack_jsteg(char *, char *, void *);
+size_t break_jsteg_size(void *);
+int break_jsteg_compare(void *, void *);
+void *break_jsteg_state_new(void);
+void break_jsteg_state_free(void *);
+int crack_jsteg(void *, char *, void *);
+int crack_jsteg_group(void *, char **, int, void *);
+void crack_jsteg_report(void *, char *, char *, void *);
+u_int64_t break_jsteg_keyclass(char *);
+void break_jsteg_keyword(u_int64_t, char *);
 
 void *break_jsteg_read(char *);
-int break_jsteg_write(char *, void *);
+void *break_jsteg_unpack(char *, u_char *, size_t);
+size_t break_jsteg_pack(void *);
 
 #endif /* _BREAK_JSTEG_ */
@@ -29,6 +29,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/queue.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -48,6 +49,8 @@
 #include "common.h"
 #include "arc4.h"
 #include "break_outguess.h"
+#include "db.h"
+#include "rpp.h"
 
 #ifndef MIN
 #define		MIN(a,b) (((a)<(b))?(a):(b))
@@ -60,6 +63,7 @@ struct ogobj {
 
 #define DEFAULT_ITER	256
 #define INIT_SKIPMOD	32
+#define OG_MAXBUF	512
 #define SKIPADJ(x,y)	((y) > (x)/32 ? 2 : 2 - ((x/32) - (y))/(float)(x/32))
 
 typedef struct _iterator {
@@ -68,8 +72,42 @@ typedef struct _iterator {
 	int off;		/* Current bit position */
 } iterator;
 
+#define OG_HDRBITS	32
+
+/*
+ * The header depends only on the word, not on the image: where its
+ * bits are and the key stream it is encrypted with.
+ */
+struct oghdr {
+	int pos[OG_HDRBITS];
+	u_char xor[OG_HDRBITS / 8];
+};
+
+/*
+ * Per-thread cracking state.  For each word, as is the key stream
+ * from its start and it the iterator just past the header.
+ */
+struct ogstate {
+	u_char oword[57];
+	int init;
+	struct arc4_stream as;
+	iterator it;
+	struct oghdr hdr;
+
+	u_char buf[OG_MAXBUF];	/* Decrypted message of the last hit */
+	int buflen;
+
+	/* Keys of the group of words from crack_outguess_group */
+	int ngroup;
+	char gword[DB_GROUP][RULE_WORD_SIZE];
+	struct arc4_stream gas[DB_GROUP];
+	iterator git[DB_GROUP];
+	struct oghdr ghdr[DB_GROUP];
+};
+
+void break_outguess_header(struct arc4_stream *, iterator *, struct oghdr *);
 int break_outguess(struct ogobj *, struct arc4_stream *, iterator *,
-    char **, int *);
+    struct oghdr *, u_char *, int *);
 
 /* Globals */
 int min_len = 256;
@@ -94,6 +132,29 @@ iterator_init(iterator *iter, struct arc4_stream *as)
 	iter->off = arc4_getword(&iter->as) % iter->skipmod;
 }
 
+/* iterator_init for several streams, their key schedules run together */
+
+void
+iterator_init_multi(iterator *iter, struct arc4_stream *as, int n)
+{
+	struct arc4_stream *pas[DB_GROUP];
+	u_char derive[DB_GROUP][16], *pderive[DB_GROUP];
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		iter[i].skipmod = INIT_SKIPMOD;
+		iter[i].as = as[i];
+		for (j = 0; j < sizeof(derive[i]); j++)
+			derive[i][j] = arc4_getbyte(&iter[i].as);
+		pas[i] = &iter[i].as;
+		pderive[i] = derive[i];
+	}
+	arc4_addrandom_multi(pas, n, pderive, sizeof(derive[0]));
+
+	for (i = 0; i < n; i++)
+		iter[i].off = arc4_getword(&iter[i].as) % iter[i].skipmod;
+}
+
 #define iterator_current(x)	(x)->off
 
 int
@@ -139,59 +200,60 @@ steg_retrbyte(u_int32_t *bitmap, int bits, iterator *iter)
 }
 
 void *
-break_outguess_read(char *filename)
+break_outguess_unpack(char *filename, u_char *buf, size_t len)
 {
 	struct ogobj *ogob;
-	int fd, i;
+	int i;
 
-	fd = open(filename, O_RDONLY, 0);
-	if (fd == -1) {
-		fprintf(stderr, "%s : error: %s\n",
-			filename, strerror(errno));
+	if (len != sizeof(struct ogobj))
 		return (NULL);
-	}
 
 	ogob = malloc(sizeof(struct ogobj));
 	if (ogob == NULL)
 		err(1, "malloc");
 
-	if (read(fd, ogob, sizeof(*ogob)) != sizeof(*ogob)) {
-		close(fd);
-		free(ogob);
-		return (NULL);
-	}
+	memcpy(ogob, buf, sizeof(*ogob));
 
 	ogob->bits = ntohl(ogob->bits);
 	for (i = 0; i < sizeof(ogob->coeff)/sizeof(u_int32_t); i++)
 		ogob->coeff[i] = ntohl(ogob->coeff[i]);
 
+	return (ogob);
+}
+
+void *
+break_outguess_read(char *filename)
+{
+	u_char buf[sizeof(struct ogobj)];
+	ssize_t n;
+	int fd;
+
+	fd = open(filename, O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, "%s : error: %s\n",
+			filename, strerror(errno));
+		return (NULL);
+	}
+
+	n = read(fd, buf, sizeof(buf));
 	close(fd);
+	if (n == -1)
+		return (NULL);
 
-	return (ogob);
+	return (break_outguess_unpack(filename, buf, n));
 }
 
-int
-break_outguess_write(char *filename, void *arg)
+size_t
+break_outguess_pack(void *arg)
 {
 	struct ogobj *ogob = arg;
-	int fd, i;
-
-	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-	if (fd == -1)
-		return (-1);
+	int i;
 
 	ogob->bits = htonl(ogob->bits);
 	for (i = 0; i < sizeof(ogob->coeff)/sizeof(u_int32_t); i++)
 		ogob->coeff[i] = htonl(ogob->coeff[i]);
 
-	if (write(fd, ogob, sizeof(*ogob)) != sizeof(*ogob)) {
-		close(fd);
-		return (-1);
-	}
-
-	close(fd);
-
-	return (0);
+	return (sizeof(*ogob));
 }
 
 void
@@ -200,6 +262,12 @@ break_outguess_destroy(void *obj)
 	free(obj);
 }
 
+size_t
+break_outguess_size(void *obj)
+{
+	return (sizeof(struct ogobj));
+}
+
 void *
 break_outguess_prepare(short *dcts, int bits)
 {
@@ -207,9 +275,9 @@ break_outguess_prepare(short *dcts, int bits)
 	int i, j, max;
 	short val;
 	
-	ogob = malloc(sizeof(struct ogobj));
+	ogob = calloc(1, sizeof(struct ogobj));
 	if (ogob == NULL)
-		err(1, "malloc");
+		err(1, "calloc");
 
 	ogob->bits = bits;
 
@@ -225,68 +293,149 @@ break_outguess_prepare(short *dcts, int bits)
 	return (ogob);
 }
 
+void *
+break_outguess_state_new(void)
+{
+	struct ogstate *st;
+
+	if ((st = calloc(1, sizeof(struct ogstate))) == NULL)
+		err(1, "calloc");
+
+	return (st);
+}
+
+void
+break_outguess_state_free(void *arg)
+{
+	free(arg);
+}
+
 int
-crack_outguess(char *filename, char *word, void *obj)
+crack_outguess(void *arg, char *word, void *obj)
 {
-	static u_char oword[57];	/* version 3 marker */
-	static int init;
-	static struct arc4_stream as;
-	static iterator it;
-	char *buf;
-	int buflen;
-	
-	struct arc4_stream tas;
-	iterator tit;
+	struct ogstate *st = arg;
 	struct ogobj *ogob = obj;
 	int changed = 0;
 
-	if (strcmp(word, oword)) {
-		strlcpy(oword, word, sizeof(oword));
+	if (strcmp(word, st->oword)) {
+		strlcpy(st->oword, word, sizeof(st->oword));
 		changed = 1;
-		init = 0;
+		st->init = 0;
 	}
 
-	if (!init || changed) {
-		arc4_initkey(&as, word, strlen(word));
-		iterator_init(&it, &as);
-		init = 1;
+	if (!st->init || changed) {
+		arc4_initkey(&st->as, word, strlen(word));
+		iterator_init(&st->it, &st->as);
+		break_outguess_header(&st->as, &st->it, &st->hdr);
+		st->init = 1;
 	}
 
-	tas = as;
-	tit = it;
-	if (break_outguess(ogob, &tas, &tit, &buf, &buflen)) {
-		int i;
-		extern int noprint;
-		fprintf(stdout, "%s : outguess[v0.13b](%s)[",
-			filename, word);
-		noprint = 0;
-		file_process(buf, buflen);
-		noprint = 1;
-		fprintf(stdout, "][");
-		for (i = 0; i < 16; i++)
-			fprintf(stdout, "%c",
-			    isprint(buf[i]) ? buf[i] : '.');
-		fprintf(stdout, "]\n");
-		return (1);
+	return (break_outguess(ogob, &st->as, &st->it, &st->hdr,
+		    st->buf, &st->buflen));
+}
+
+/*
+ * Tries a group of words.  The MD5 digests and the key schedules of
+ * all words are computed together, once per group.
+ */
+
+int
+crack_outguess_group(void *arg, char **words, int n, void *obj)
+{
+	struct ogstate *st = arg;
+	struct ogobj *ogob = obj;
+	u_char *keys[DB_GROUP];
+	int i, lens[DB_GROUP];
+
+	if (n > DB_GROUP)
+		errx(1, "%s: too many words: %d", __func__, n);
+
+	for (i = 0; i < n && i < st->ngroup; i++)
+		if (strcmp(words[i], st->gword[i]))
+			break;
+	if (i < n || n != st->ngroup) {
+		for (i = 0; i < n; i++) {
+			strlcpy(st->gword[i], words[i], sizeof(st->gword[i]));
+			keys[i] = (u_char *)words[i];
+			lens[i] = strlen(words[i]);
+		}
+		arc4_initkey_multi(st->gas, n, keys, lens);
+		iterator_init_multi(st->git, st->gas, n);
+		for (i = 0; i < n; i++)
+			break_outguess_header(&st->gas[i], &st->git[i],
+			    &st->ghdr[i]);
+		st->ngroup = n;
 	}
 
-	return (0);
+	for (i = 0; i < n; i++)
+		if (break_outguess(ogob, &st->gas[i], &st->git[i],
+			&st->ghdr[i], st->buf, &st->buflen))
+			return (i);
+
+	return (-1);
+}
+
+/* Called with db_lock held */
+void
+crack_outguess_report(void *arg, char *filename, char *word, void *obj)
+{
+	struct ogstate *st = arg;
+	extern int noprint;
+	int i;
+
+	fprintf(stdout, "%s : outguess[v0.13b](%s)[", filename, word);
+	noprint = 0;
+	file_process(st->buf, st->buflen);
+	noprint = 1;
+	fprintf(stdout, "][");
+	for (i = 0; i < 16; i++)
+		fprintf(stdout, "%c",
+		    isprint(st->buf[i]) ? st->buf[i] : '.');
+	fprintf(stdout, "]\n");
+}
+
+/*
+ * Moves the iterator of a new word past the header and records where
+ * the header bits are and how they are encrypted.
+ */
+
+void
+break_outguess_header(struct arc4_stream *as, iterator *it,
+    struct oghdr *hdr)
+{
+	struct arc4_stream tas = *as;
+	int i;
+
+	for (i = 0; i < OG_HDRBITS; i++) {
+		hdr->pos[i] = iterator_current(it);
+		iterator_next(it);
+	}
+	for (i = 0; i < sizeof(hdr->xor); i++)
+		hdr->xor[i] = arc4_getbyte(&tas);
 }
 
+/*
+ * Most images fail on the seed or length in the header, which takes
+ * just its 32 bits.  The iterator and key stream of the word are only
+ * copied for the ones that pass.
+ */
+
 int
 break_outguess(struct ogobj *og, struct arc4_stream *as, iterator *it,
-    char **pbuf, int *pbuflen)
+    struct oghdr *hdr, u_char *buf, int *pbuflen)
 {
-	u_char state[4];
-	static u_char buf[512];
-	struct arc4_stream tas = *as;
+	u_char state[OG_HDRBITS / 8];
+	struct arc4_stream tas;
+	iterator tit;
 	int length, seed, need;
-	int bits, i, n;
+	int bits, i, j, n;
 
-	state[0] = steg_retrbyte(og->coeff, 8, it) ^ arc4_getbyte(as);
-	state[1] = steg_retrbyte(og->coeff, 8, it) ^ arc4_getbyte(as);
-	state[2] = steg_retrbyte(og->coeff, 8, it) ^ arc4_getbyte(as);
-	state[3] = steg_retrbyte(og->coeff, 8, it) ^ arc4_getbyte(as);
+	for (i = 0; i < sizeof(state); i++) {
+		state[i] = hdr->xor[i];
+		for (j = 0; j < 8; j++)
+			if (TEST_BIT(og->coeff, hdr->pos[i * 8 + j]))
+				state[i] ^= 1 << j;
+	}
 
 	seed = (state[1] << 8) | state[0];
 	length = (state[3] << 8) | state[2];
@@ -294,30 +443,31 @@ break_outguess(struct ogobj *og, struct arc4_stream *as, iterator *it,
 	if (seed > max_seed || length * 8 >= og->bits/2 || length < min_len)
 		return (0);
 
-	iterator_seed(it, seed);
+	tit = *it;
+	iterator_seed(&tit, seed);
 
 	bits = MIN(og->bits, sizeof(og->coeff) * 8);
 
 	n = 0;
-	while (iterator_current(it) < bits && length > 0 && n < sizeof(buf)) {
-		iterator_adapt(it, og->bits, length);
-		buf[n++] = steg_retrbyte(og->coeff, 8, it);
+	while (iterator_current(&tit) < bits && length > 0 && n < OG_MAXBUF) {
+		iterator_adapt(&tit, og->bits, length);
+		buf[n++] = steg_retrbyte(og->coeff, 8, &tit);
 		length--;
 	}
 
 	/* For testing the randomness, we need some extra information */
-	need = MIN(min_len, sizeof(buf));
+	need = MIN(min_len, OG_MAXBUF);
 	if (n < need || !is_random(buf, n))
 		return (0);
 
 	/* Plaintext tests? */
+	tas = *as;
 	for (i = 0; i < n; i++)
 		buf[i] ^= arc4_getbyte(&tas);
 
-	if (file_process(buf, n) == 0)
+	if (file_plausible_text(buf, n) == 0)
 		return (0);
 
-	*pbuf = buf;
 	*pbuflen = n;
 
 	return (1);
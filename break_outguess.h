@@ -33,9 +33,15 @@
 
 void *break_outguess_prepare(short *, int);
 void break_outguess_destroy(void *);
-int crack_outguess(char *, char *, void *);
+size_t break_outguess_size(void *);
+void *break_outguess_state_new(void);
+void break_outguess_state_free(void *);
+int crack_outguess(void *, char *, void *);
+int crack_outguess_group(void *, char **, int, void *);
+void crack_outguess_report(void *, char *, char *, void *);
 
 void *break_outguess_read(char *);
-int break_outguess_write(char *, void *);
+void *break_outguess_unpack(char *, u_char *, size_t);
+size_t break_outguess_pack(void *);
 
 #endif /* _BREAK_OUTGUESS_ */
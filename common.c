@@ -734,32 +734,73 @@ file_hasextension(char *name, char *ext)
 
 #define NBUCKETS	64
 
-u_char table[256];
+/* Number of bits set in a byte; constant so that threads can share it */
+#define B2(n)	n, n + 1, n + 1, n + 2
+#define B4(n)	B2(n), B2(n + 1), B2(n + 1), B2(n + 2)
+#define B6(n)	B4(n), B4(n + 1), B4(n + 1), B4(n + 2)
+static const u_char table[256] = { B6(0), B6(1), B6(1), B6(2) };
+
+/* Each byte with its bits in reverse order */
+#define R2(n)	n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n)	R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n)	R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+static const u_char reverse[256] = { R6(0), R6(2), R6(1), R6(3) };
+
+#define LOAD64(p)	((u_int64_t)(p)[0] | (u_int64_t)(p)[1] << 8 | \
+			 (u_int64_t)(p)[2] << 16 | (u_int64_t)(p)[3] << 24 | \
+			 (u_int64_t)(p)[4] << 32 | (u_int64_t)(p)[5] << 40 | \
+			 (u_int64_t)(p)[6] << 48 | (u_int64_t)(p)[7] << 56)
+
+#ifdef HAVE_POPCNT
+static __attribute__((target("popcnt"))) int
+count_ones_popcnt(u_char *buf, int size)
+{
+	int i, one = 0;
+
+	for (i = 0; i + 8 <= size; i += 8)
+		one += __builtin_popcountll(LOAD64(buf + i));
+	for (; i < size; i++)
+		one += table[buf[i]];
+
+	return (one);
+}
+#endif
+
+static int
+count_ones(u_char *buf, int size)
+{
+	u_int64_t x;
+	int i, one = 0;
+
+#ifdef HAVE_POPCNT
+	if (__builtin_cpu_supports("popcnt"))
+		return (count_ones_popcnt(buf, size));
+#endif
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		x = LOAD64(buf + i);
+		x -= (x >> 1) & 0x5555555555555555ULL;
+		x = (x & 0x3333333333333333ULL) +
+		    ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		one += (x * 0x0101010101010101ULL) >> 56;
+	}
+	for (; i < size; i++)
+		one += table[buf[i]];
+
+	return (one);
+}
 
 int
 is_random(u_char *buf, int size)
 {
-	static int initalized;
-	u_char *p, val;
+	u_char rev[8];
+	u_int64_t w;
 	int bucket[NBUCKETS];
-	int i, j, one;
+	int i, j, k, n, one;
 	float tmp, sum, exp, ratio;
 
-	if (!initalized) {
-		table[0] = 0; table[1] = 1; table[2] = 1; table[3] = 2;
-		table[4] = 1; table[5] = 2; table[6] = 2; table[7] = 3;
-
-		for (i = 8; i < 16; i++)
-			table[i] = 1 + table[i & 0x7];
-		for (i = 16; i < 256; i++)
-			table[i] = table[(i >> 4) & 0xf] + table[i & 0xf];
-
-		initalized = 1;
-	}
-	
-	one = 0;
-	for (i = 0; i < size; i++)
-		one += table[buf[i]];
+	one = count_ones(buf, size);
 
 	ratio = (float)one/(size * 8);
 #if BREAKOG_DEBUG
@@ -768,18 +809,26 @@ is_random(u_char *buf, int size)
 #endif
 	if (ratio < 0.46 || ratio > 0.54)
 		return (0);
-	/* Chi^2 Test */
+	/*
+	 * Chi^2 Test over the 6-bit window at each bit position.  The
+	 * window starts with the bits of buf[0] from the lowest and then
+	 * takes the bits of each following byte from the highest.  With
+	 * those bytes reversed, the bits are in order, and each 64-bit
+	 * word yields 56 windows.
+	 */
 	memset(bucket, 0, sizeof(bucket));
-	one = buf[0];
-	val = 0;
-	p = &buf[1];
-	for (j = 0; j < (size-1)*8; j++) {
-		bucket[one & (NBUCKETS-1)]++;
-		if ((j % 8) == 0)
-			val = *p++;
-		one >>= 1;
-		one |= (val & 0x80);
-		val <<= 1;
+	n = (size - 1) * 8;
+	for (i = 0, j = 0; j + 56 <= n && i + 8 <= size; i += 7, j += 56) {
+		for (k = 0; k < 8; k++)
+			rev[k] = i + k ? reverse[buf[i + k]] : buf[0];
+		w = LOAD64(rev);
+		for (k = 0; k < 56; k++)
+			bucket[(w >> k) & (NBUCKETS-1)]++;
+	}
+	for (; j < n; i++, j += 8) {
+		one = (i ? reverse[buf[i]] : buf[0]) | reverse[buf[i + 1]] << 8;
+		for (k = 0; k < 8; k++)
+			bucket[(one >> k) & (NBUCKETS-1)]++;
 	}
 
 	exp = (float)j/NBUCKETS;
@@ -33,96 +33,622 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
 #include <err.h>
 
 #include "config.h"
+#include "rpp.h"
+#include "ring.h"
 #include "db.h"
 
-extern int count;
-extern int found;
+#ifndef HAVE_STRLCPY
+size_t strlcpy(char *, const char *, size_t);
+#endif
 
-struct dbqueue dblist;
+struct dbbatch {
+	int nwords;
+	char words[DB_BATCH][RULE_WORD_SIZE];
+};
+
+struct dbworker {
+	pthread_t tid;
+	void *state[DB_MAXTYPES];
+	u_int32_t count;
+};
+
+/*
+ * The images of one type.  They are kept in arrays, appended by
+ * db_insert and sorted with the compare function of the type once,
+ * before the first word is cracked.
+ */
+struct dbset {
+	int n, size;
+	void **obj;
+	char **filename;
+	u_char *found;		/* Cracked, removed by db_flush */
+};
+
+static struct dbtype *dbtypes[DB_MAXTYPES];
+static struct dbset dbsets[DB_MAXTYPES];
+static int ndbtypes;
+static int dbleft;		/* Images that have not been cracked */
+static int dbsorted;		/* No images inserted since db_sort */
+static size_t dbmemory;		/* Used by the images */
+static int found;
+
+/*
+ * The key classes that have been cracked against all images, for each
+ * type with a keyclass function.  A slot keeps the last class hashed to
+ * it, so equivalent words are only skipped while their class is still
+ * remembered.
+ */
+static u_int64_t *dbclasses[DB_MAXTYPES];
+
+static struct dbworker dbworkers[DB_MAXTHREADS];
+static int nthreads = 1;
+static int started;
+static int ngroups;		/* Types with crack_group */
+static struct dbbatch single;	/* Words of the current group without threads */
+
+/*
+ * Batches of words travel to the workers through the work ring and
+ * come back through the free ring.  Both rings can hold all batches,
+ * so putting a batch never fails.
+ */
+static struct ring *workring, *freering;
+static u_long submitted, completed;
+static struct dbbatch *current;
+
+/* Serializes reports and the file magic library */
+static pthread_mutex_t dboutlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t dbsortlock = PTHREAD_MUTEX_INITIALIZER;
 
 void
-db_init(void)
+db_init(int n)
 {
-	TAILQ_INIT(&dblist);
+	nthreads = n;
 }
 
 void
-db_insert(char *filename, int type, void *obj,
-    int (*crack)(char *, char *, void *),
-    int (*compare)(void *, void *),
-    void (*free)(void *))
+db_register(struct dbtype *dbt)
 {
-	struct db *db, *tmp;
+	if (ndbtypes >= DB_MAXTYPES)
+		errx(1, "%s: too many types", __func__);
 
-	if ((db = malloc(sizeof(struct db))) == NULL)
-		err(1, "malloc");
+	dbt->index = ndbtypes;
+	dbtypes[ndbtypes++] = dbt;
+	if (dbt->crack_group != NULL)
+		ngroups++;
+
+	if (dbt->keyclass != NULL) {
+		dbclasses[dbt->index] = calloc(1 << DB_CLASSBITS,
+		    sizeof(u_int64_t));
+		if (dbclasses[dbt->index] == NULL)
+			err(1, "calloc");
+	}
+}
+
+void
+db_lock(void)
+{
+	pthread_mutex_lock(&dboutlock);
+}
+
+void
+db_unlock(void)
+{
+	pthread_mutex_unlock(&dboutlock);
+}
+
+u_int32_t
+db_cracks(void)
+{
+	u_int32_t count = 0;
+	int i;
 
-	db->filename = strdup(filename);
-	if (db->filename == NULL)
+	for (i = 0; i < nthreads; i++)
+		count += dbworkers[i].count;
+
+	return (count);
+}
+
+/*
+ * Upper bound for the number of words that the calling thread has
+ * handed to the database but that might not be cracked yet.  Batches
+ * finish out of order, but only nthreads of them are being cracked.
+ */
+
+u_long
+db_pending(void)
+{
+	u_long n = single.nwords;
+
+	if (current != NULL)
+		n += current->nwords;
+	if (started)
+		n += (__atomic_load_n(&submitted, __ATOMIC_ACQUIRE) -
+		    __atomic_load_n(&completed, __ATOMIC_ACQUIRE) +
+		    nthreads) * DB_BATCH;
+
+	return (n);
+}
+
+/* Approximate memory used by the images that have been inserted */
+
+size_t
+db_memory(void)
+{
+	return (dbmemory);
+}
+
+int
+db_found(void)
+{
+	return (found);
+}
+
+void
+db_insert(char *filename, struct dbtype *dbt, void *obj)
+{
+	struct dbset *set = &dbsets[dbt->index];
+	int size;
+
+	if (set->n >= set->size) {
+		size = set->size ? 2 * set->size : 64;
+		set->obj = realloc(set->obj, size * sizeof(void *));
+		set->filename = realloc(set->filename, size * sizeof(char *));
+		set->found = realloc(set->found, size);
+		if (set->obj == NULL || set->filename == NULL ||
+		    set->found == NULL)
+			err(1, "realloc");
+		set->size = size;
+	}
+
+	set->obj[set->n] = obj;
+	if ((set->filename[set->n] = strdup(filename)) == NULL)
 		err(1, "strdup");
-	db->type = type;
-	db->obj = obj;
-	db->crack = crack;
-	db->free = free;
+	set->found[set->n] = 0;
+	set->n++;
+
+	dbmemory += dbt->size(obj) + strlen(filename) + 1 +
+	    sizeof(void *) + sizeof(char *) + sizeof(u_char);
+	dbleft++;
+	dbsorted = 0;
+}
+
+static struct dbtype *sorttype;
+static void **sortobj;
+
+int
+db_sort_compare(const void *a, const void *b)
+{
+	int ia = *(const int *)a, ib = *(const int *)b;
+	int res;
+
+	if ((res = sorttype->compare(sortobj[ia], sortobj[ib])) != 0)
+		return (res);
+
+	return (ia - ib);
+}
+
+/* Sorts the images of a type by an index, which is then applied */
+
+void
+db_sort_set(struct dbtype *dbt, struct dbset *set)
+{
+	void **obj;
+	char **filename;
+	int i, *idx;
+
+	if (dbt->compare == NULL || set->n < 2)
+		return;
+
+	if ((idx = malloc(set->n * sizeof(int))) == NULL)
+		err(1, "malloc");
+	if ((obj = malloc(set->n * sizeof(void *))) == NULL)
+		err(1, "malloc");
+	if ((filename = malloc(set->n * sizeof(char *))) == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < set->n; i++)
+		idx[i] = i;
+	sorttype = dbt;
+	sortobj = set->obj;
+	qsort(idx, set->n, sizeof(int), db_sort_compare);
+
+	/* Nothing has been cracked since the images were inserted */
+	for (i = 0; i < set->n; i++) {
+		obj[i] = set->obj[idx[i]];
+		filename[i] = set->filename[idx[i]];
+	}
+	memcpy(set->obj, obj, set->n * sizeof(void *));
+	memcpy(set->filename, filename, set->n * sizeof(char *));
+
+	free(filename);
+	free(obj);
+	free(idx);
+}
+
+/*
+ * Sorts the images that have been inserted since the last call.  Any
+ * thread that is about to crack calls it, the first one does the work.
+ */
+
+void
+db_sort(void)
+{
+	int i;
+
+	if (__atomic_load_n(&dbsorted, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&dbsortlock);
+	if (!dbsorted) {
+		for (i = 0; i < ndbtypes; i++)
+			db_sort_set(dbtypes[i], &dbsets[i]);
+		__atomic_store_n(&dbsorted, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&dbsortlock);
+}
+
+/* Returns 1 if an equivalent word has been cracked already */
+
+int
+db_keyclass_seen(struct dbtype *dbt, char *word)
+{
+	u_int64_t class, *slot;
+
+	class = dbt->keyclass(word);
+	slot = &dbclasses[dbt->index][(class * 0x9e3779b97f4a7c15ULL) >>
+	    (64 - DB_CLASSBITS)];
+	if (__atomic_load_n(slot, __ATOMIC_RELAXED) == class)
+		return (1);
+
+	/* The word is cracked against all images from here on */
+	__atomic_store_n(slot, class, __ATOMIC_RELAXED);
+	return (0);
+}
+
+void *
+db_state(struct dbworker *worker, struct dbtype *dbt)
+{
+	if (worker->state[dbt->index] == NULL)
+		worker->state[dbt->index] = dbt->state_new();
+
+	return (worker->state[dbt->index]);
+}
+
+void
+db_cracked(struct dbtype *dbt, struct dbset *set, int i, void *state,
+    char *word)
+{
+	/* Another thread might have cracked it in the meantime */
+	db_lock();
+	if (!set->found[i]) {
+		__atomic_store_n(&set->found[i], 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&dbleft, 1, __ATOMIC_RELAXED);
+		found++;
+		dbt->report(state, set->filename[i], word, set->obj[i]);
+	}
+	db_unlock();
+}
+
+/* Tries a word against the images of types without crack_group */
+
+void
+db_crack_word(struct dbworker *worker, char *word)
+{
+	struct dbtype *dbt;
+	struct dbset *set;
+	void *state;
+	int i, t, seen;
+
+	for (t = 0; t < ndbtypes; t++) {
+		dbt = dbtypes[t];
+		set = &dbsets[t];
+		if (dbt->crack_group != NULL)
+			continue;
+
+		seen = -1;
+		state = NULL;
+		for (i = 0; i < set->n; i++) {
+			/* Checked again under the lock */
+			if (__atomic_load_n(&set->found[i], __ATOMIC_RELAXED))
+				continue;
 
-	if (compare != NULL) {
-		for (tmp = TAILQ_FIRST(&dblist); tmp;
-		     tmp = TAILQ_NEXT(tmp, next))
-			if (compare(db->obj, tmp->obj) <= 0)
-				break;
-		if (tmp)
-			TAILQ_INSERT_BEFORE(tmp, db, next);
-		else
-			TAILQ_INSERT_TAIL(&dblist, db, next);
-	} else
-		TAILQ_INSERT_TAIL(&dblist, db, next);
+			if (seen == -1) {
+				seen = dbt->keyclass != NULL &&
+				    db_keyclass_seen(dbt, word);
+				if (seen)
+					break;
+				state = db_state(worker, dbt);
+			}
+
+			worker->count++;
+			if (dbt->crack(state, word, set->obj[i]))
+				db_cracked(dbt, set, i, state, word);
+		}
+	}
 }
 
+/*
+ * Copies the words that a type has to try into twords and returns
+ * their number.  Words whose key class has been cracked are left out.
+ */
+
+int
+db_group_words(struct dbtype *dbt, char **words, int n, char **twords)
+{
+	int i, tn = 0;
+
+	for (i = 0; i < n; i++)
+		if (dbt->keyclass == NULL || !db_keyclass_seen(dbt, words[i]))
+			twords[tn++] = words[i];
+
+	return (tn);
+}
+
+/*
+ * Tries up to DB_GROUP words against all images.  Types with
+ * crack_group get all words for one image at once, so that every
+ * image is read once per group while the key schedules of the group
+ * stay in the state of the worker.  Swapping the loops would redo the
+ * key schedules, which are far more expensive than reading an image.
+ */
+
 void
-db_remove(struct db *db)
+db_crack_group(struct dbworker *worker, char **words, int n)
 {
-	TAILQ_REMOVE(&dblist, db, next);
+	struct dbtype *dbt;
+	struct dbset *set;
+	void *state;
+	char *twords[DB_GROUP];
+	int i, j, t, tn;
+
+	for (i = 0; i < n; i++)
+		db_crack_word(worker, words[i]);
+
+	if (!ngroups)
+		return;
 
-	db->free(db->obj);
-	free(db->filename);
-	free(db);
+	for (t = 0; t < ndbtypes; t++) {
+		dbt = dbtypes[t];
+		set = &dbsets[t];
+		if (dbt->crack_group == NULL)
+			continue;
+
+		tn = -1;
+		state = NULL;
+		for (i = 0; i < set->n; i++) {
+			if (__atomic_load_n(&set->found[i], __ATOMIC_RELAXED))
+				continue;
+
+			if (tn == -1) {
+				tn = db_group_words(dbt, words, n, twords);
+				if (tn == 0)
+					break;
+				state = db_state(worker, dbt);
+			}
+
+			worker->count += tn;
+			if ((j = dbt->crack_group(state, twords, tn,
+				 set->obj[i])) != -1)
+				db_cracked(dbt, set, i, state, twords[j]);
+		}
+	}
+}
+
+void
+db_crack_batch(struct dbworker *worker, struct dbbatch *batch)
+{
+	char *words[DB_GROUP];
+	int i, n;
+
+	for (i = 0; i < batch->nwords && !db_done(); i += n) {
+		for (n = 0; n < DB_GROUP && i + n < batch->nwords; n++)
+			words[n] = batch->words[i + n];
+		db_crack_group(worker, words, n);
+	}
+}
+
+void *
+db_worker(void *arg)
+{
+	struct dbworker *worker = arg;
+	struct dbbatch *batch;
+
+	for (;;) {
+		batch = ring_get_wait(workring);
+
+		db_crack_batch(worker, batch);
+
+		ring_put(freering, batch);
+		__atomic_add_fetch(&completed, 1, __ATOMIC_RELEASE);
+	}
+
+	return (NULL);
+}
+
+void
+db_start(void)
+{
+	struct dbbatch *batch;
+	sigset_t set, oset;
+	int i, nbatches;
+
+	/* Enough to keep the workers and the rule producers busy */
+	nbatches = 8 * nthreads + 8;
+	workring = ring_new(nbatches);
+	freering = ring_new(nbatches);
+	for (i = 0; i < nbatches; i++) {
+		if ((batch = malloc(sizeof(struct dbbatch))) == NULL)
+			err(1, "malloc");
+		ring_put(freering, batch);
+	}
+
+	/* Signals are for the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&dbworkers[i].tid, NULL, db_worker,
+			&dbworkers[i]) != 0)
+			errx(1, "%s: pthread_create failed", __func__);
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+	started = 1;
+}
+
+/*
+ * Word batches can be filled by any thread: db_batch_get returns an
+ * empty batch, db_batch_add copies a word into it and returns 1 when
+ * it is full, and db_batch_crack hands it to the workers.
+ */
+
+struct dbbatch *
+db_batch_get(void)
+{
+	struct dbbatch *batch;
+
+	if (!started)
+		db_start();
+	db_sort();
+
+	batch = ring_get_wait(freering);
+	batch->nwords = 0;
+
+	return (batch);
+}
+
+int
+db_batch_add(struct dbbatch *batch, char *word)
+{
+	strlcpy(batch->words[batch->nwords++], word, RULE_WORD_SIZE);
+
+	return (batch->nwords == DB_BATCH);
+}
+
+void
+db_batch_crack(struct dbbatch *batch)
+{
+	if (batch->nwords == 0) {
+		ring_put(freering, batch);
+		return;
+	}
+
+	__atomic_add_fetch(&submitted, 1, __ATOMIC_RELEASE);
+	ring_put(workring, batch);
+}
+
+/*
+ * Waits until the workers have processed all submitted words.  The
+ * caller has to make sure that no other thread is still submitting.
+ */
+
+void
+db_drain(void)
+{
+	int tries = 0;
+
+	if (single.nwords) {
+		db_crack_batch(&dbworkers[0], &single);
+		single.nwords = 0;
+	}
+
+	if (!started)
+		return;
+
+	if (current != NULL) {
+		db_batch_crack(current);
+		current = NULL;
+	}
+
+	while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) !=
+	    __atomic_load_n(&submitted, __ATOMIC_ACQUIRE))
+		ring_backoff(&tries);
+}
+
+/*
+ * Calls cb with the filename of every image and whether it has been
+ * cracked.  Only called while no thread is cracking.
+ */
+
+void
+db_images(void (*cb)(char *, int, void *), void *arg)
+{
+	struct dbset *set;
+	int i, t;
+
+	for (t = 0; t < ndbtypes; t++) {
+		set = &dbsets[t];
+		for (i = 0; i < set->n; i++)
+			cb(set->filename[i], set->found[i], arg);
+	}
 }
 
 void
 db_flush(void)
 {
-	struct db *db;
+	struct dbset *set;
 	extern int quiet;
+	int i, t;
+
+	db_drain();
 
-	for (db = TAILQ_FIRST(&dblist); db; db = TAILQ_FIRST(&dblist)) {
-		if (!quiet)
-			fprintf(stdout, "%s : negative\n", db->filename);
-		db_remove(db);
+	for (t = 0; t < ndbtypes; t++) {
+		set = &dbsets[t];
+		for (i = 0; i < set->n; i++) {
+			if (!quiet && !set->found[i])
+				fprintf(stdout, "%s : negative\n",
+				    set->filename[i]);
+			dbtypes[t]->free(set->obj[i]);
+			free(set->filename[i]);
+		}
+		set->n = 0;
 	}
+	dbleft = 0;
+	dbmemory = 0;
+
+	/* The next images have not seen any key class */
+	for (i = 0; i < ndbtypes; i++)
+		if (dbclasses[i] != NULL)
+			memset(dbclasses[i], 0,
+			    (1 << DB_CLASSBITS) * sizeof(u_int64_t));
 }
 
+/*
+ * Tries a word against all images.  The word is queued and cracked
+ * later, by the threads or, without threads, once a group of words is
+ * complete; the return value tells if all images have been found so
+ * far.
+ */
+
 int
 db_crack(char *word)
 {
-	struct db *db, *next;
-	int res;
+	if (nthreads <= 1) {
+		db_sort();
+		db_batch_add(&single, word);
+		if (single.nwords == DB_GROUP) {
+			db_crack_batch(&dbworkers[0], &single);
+			single.nwords = 0;
+		}
+		return (db_done());
+	}
 
-	for(db = TAILQ_FIRST(&dblist); db; db = next) {
-		next = TAILQ_NEXT(db, next);
+	if (current == NULL)
+		current = db_batch_get();
 
-		count++;
-		res = (*db->crack)(db->filename, word, db->obj);
-		if (res) {
-			found++;
-			db_remove(db);
-		}
+	if (db_batch_add(current, word)) {
+		db_batch_crack(current);
+		current = NULL;
 	}
 
-	if (TAILQ_FIRST(&dblist) == NULL)
-		return (1);
+	return (db_done());
+}
 
-	return (0);
+int
+db_done(void)
+{
+	return (__atomic_load_n(&dbleft, __ATOMIC_RELAXED) == 0);
 }
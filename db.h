@@ -31,28 +31,61 @@
 #ifndef _DB_H_
 #define _DB_H_
 
-TAILQ_HEAD(dbqueue, db);
-extern struct dbqueue dblist;
-
-struct db {
-	TAILQ_ENTRY (db) next;
+#define DB_MAXTYPES	8
+#define DB_MAXTHREADS	64
+#define DB_BATCH	256	/* Words handed to a thread at a time */
+#define DB_CLASSBITS	18	/* Remembered key classes per type */
+#define DB_GROUP	16	/* Words for one crack_group call */
 
+/*
+ * The operations of one steganographic system.  Each cracking thread
+ * gets its own state from state_new, which crack uses to keep key
+ * schedules between images.  report prints a successful crack and is
+ * called by the same thread with the state of that crack.  The images
+ * of a type are cracked in the order of compare, if it is given.  If
+ * words can be equivalent keys, keyclass maps a word to a non-zero
+ * number that is the same for all equivalent words.  Types that can
+ * try several words at once provide crack_group, which returns the
+ * index of the word that cracked the image or -1; they get up to
+ * DB_GROUP words at a time instead of calls to crack.  size returns
+ * the memory used by an object.
+ */
+struct dbtype {
 	int type;
-	char *filename;
-	void *obj;
-	int (*crack)(char *, char *, void *);
+	int (*crack)(void *, char *, void *);
+	void (*report)(void *, char *, char *, void *);
 	int (*compare)(void *, void *);
 	void (*free)(void *);
+	void *(*state_new)(void);
+	void (*state_free)(void *);
+	u_int64_t (*keyclass)(char *);
+	int (*crack_group)(void *, char **, int, void *);
+	size_t (*size)(void *);
+
+	int index;		/* Assigned by db_register */
 };
 
-void db_init(void);
-void db_insert(char *filename, int type, void *obj,
-    int (*crack)(char *, char *, void *),
-    int (*compare)(void *, void *),
-    void (*free)(void *));
+void db_init(int nthreads);
+void db_register(struct dbtype *);
+void db_insert(char *filename, struct dbtype *, void *obj);
 int db_crack(char *);
-void db_remove(struct db *db);
+int db_done(void);
 void db_flush(void);
+void db_drain(void);
+void db_images(void (*)(char *, int, void *), void *);
+
+struct dbbatch;
+struct dbbatch *db_batch_get(void);
+int db_batch_add(struct dbbatch *, char *);
+void db_batch_crack(struct dbbatch *);
+
+u_int32_t db_cracks(void);
+u_long db_pending(void);
+size_t db_memory(void);
+int db_found(void);
+
+void db_lock(void);
+void db_unlock(void);
 
 #endif /* _DB_H_ */
 
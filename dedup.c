@@ -0,0 +1,256 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "dedup.h"
+
+#define DEDUP_MAXHASHES	32
+
+struct dedupent {
+	u_int32_t hash;
+	u_int32_t off;		/* Offset + 1 in the arena, 0 if empty */
+};
+
+static u_int64_t
+dedup_hash(char *word)
+{
+	u_int64_t h = 0xcbf29ce484222325ULL;
+	u_char *p;
+
+	/* FNV-1a followed by a finalizer that spreads the low bits */
+	for (p = (u_char *)word; *p; p++) {
+		h ^= *p;
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return (h);
+}
+
+/* Largest power of two that is not larger than n */
+
+static size_t
+dedup_pow2(size_t n)
+{
+	size_t p = 1;
+
+	while (p <= n / 2)
+		p <<= 1;
+	return (p);
+}
+
+/*
+ * A false positive rate of zero creates an exact set; the table takes
+ * a quarter of the memory and the words are kept in the rest.
+ */
+
+struct dedup *
+dedup_new(size_t memory, double fprate)
+{
+	struct dedup *dd;
+	size_t nbits;
+	double p;
+
+	if (memory < 1024)
+		memory = 1024;
+
+	if ((dd = calloc(1, sizeof(struct dedup))) == NULL)
+		err(1, "calloc");
+
+	pthread_mutex_init(&dd->lock, NULL);
+	dd->memory = memory;
+	dd->fprate = fprate;
+
+	if (fprate > 0) {
+		nbits = dedup_pow2(memory) * 8;
+		if ((dd->bits = malloc(nbits / 8)) == NULL)
+			err(1, "malloc");
+		dd->bitmask = nbits - 1;
+
+		/* Optimal filters use log2(1/p) hashes */
+		for (dd->nhashes = 1, p = 0.5;
+		     p > fprate && dd->nhashes < DEDUP_MAXHASHES;
+		     dd->nhashes++)
+			p /= 2;
+		dd->capacity = nbits / dd->nhashes * 693 / 1000;
+	} else {
+		size_t slots;
+
+		slots = dedup_pow2(memory / 4 / sizeof(struct dedupent));
+		if ((dd->table = malloc(slots * sizeof(struct dedupent)))
+		    == NULL)
+			err(1, "malloc");
+		dd->tablemask = slots - 1;
+		dd->capacity = slots / 2;
+
+		dd->arenasize = memory - slots * sizeof(struct dedupent);
+		if (dd->arenasize > 0xffffffffU)
+			dd->arenasize = 0xffffffffU;
+		if ((dd->arena = malloc(dd->arenasize)) == NULL)
+			err(1, "malloc");
+	}
+
+	dedup_clear(dd);
+
+	return (dd);
+}
+
+void
+dedup_free(struct dedup *dd)
+{
+	pthread_mutex_destroy(&dd->lock);
+	free(dd->bits);
+	free(dd->table);
+	free(dd->arena);
+	free(dd);
+}
+
+/* Forgets all words, but keeps the count of removed duplicates */
+
+void
+dedup_clear(struct dedup *dd)
+{
+	if (dd->bits != NULL)
+		memset(dd->bits, 0, (dd->bitmask + 1) / 8);
+	if (dd->table != NULL)
+		memset(dd->table, 0,
+		    (dd->tablemask + 1) * sizeof(struct dedupent));
+	dd->arenalen = 0;
+	dd->entries = 0;
+}
+
+static int
+dedup_seen_exact(struct dedup *dd, char *word, u_int64_t hash)
+{
+	struct dedupent *ent;
+	size_t i, len;
+	int res = 0;
+
+	pthread_mutex_lock(&dd->lock);
+	for (i = hash & dd->tablemask; dd->table[i].off;
+	     i = (i + 1) & dd->tablemask) {
+		ent = &dd->table[i];
+		if (ent->hash == (u_int32_t)hash &&
+		    !strcmp(dd->arena + ent->off - 1, word)) {
+			res = 1;
+			goto out;
+		}
+	}
+
+	len = strlen(word) + 1;
+	if (dd->entries >= dd->capacity ||
+	    dd->arenasize - dd->arenalen < len)
+		goto out;
+
+	memcpy(dd->arena + dd->arenalen, word, len);
+	dd->table[i].hash = hash;
+	dd->table[i].off = dd->arenalen + 1;
+	dd->arenalen += len;
+	dd->entries++;
+ out:
+	pthread_mutex_unlock(&dd->lock);
+
+	return (res);
+}
+
+/*
+ * The bits are set atomically, so producers need no lock.  Two threads
+ * that insert the same word at once may both crack it.
+ */
+
+static int
+dedup_seen_bloom(struct dedup *dd, char *word, u_int64_t hash)
+{
+	u_int64_t h2, old, bit;
+	size_t pos;
+	int i, seen = 1, insert;
+
+	insert = __atomic_load_n(&dd->entries, __ATOMIC_RELAXED) <
+	    dd->capacity;
+
+	h2 = (hash >> 32 | hash << 32) | 1;
+	for (i = 0; i < dd->nhashes; i++, hash += h2) {
+		pos = hash & dd->bitmask;
+		bit = (u_int64_t)1 << (pos & 63);
+		if (insert)
+			old = __atomic_fetch_or(&dd->bits[pos >> 6], bit,
+			    __ATOMIC_RELAXED);
+		else
+			old = __atomic_load_n(&dd->bits[pos >> 6],
+			    __ATOMIC_RELAXED);
+		if (!(old & bit)) {
+			seen = 0;
+			if (!insert)
+				break;
+		}
+	}
+
+	if (!seen && insert)
+		__atomic_add_fetch(&dd->entries, 1, __ATOMIC_RELAXED);
+
+	return (seen);
+}
+
+/* Returns 1 if the word was seen before, otherwise remembers it */
+
+int
+dedup_seen(struct dedup *dd, char *word)
+{
+	u_int64_t hash;
+	int seen;
+
+	hash = dedup_hash(word);
+	if (dd->bits != NULL)
+		seen = dedup_seen_bloom(dd, word, hash);
+	else
+		seen = dedup_seen_exact(dd, word, hash);
+
+	if (seen)
+		__atomic_add_fetch(&dd->removed, 1, __ATOMIC_RELAXED);
+
+	return (seen);
+}
+
+u_int64_t
+dedup_removed(struct dedup *dd)
+{
+	return (__atomic_load_n(&dd->removed, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _DEDUP_H_
+#define _DEDUP_H_
+
+/*
+ * Remembers the candidates that have been cracked already, so that a
+ * word produced again by another rule or wordlist line is skipped.
+ * Either an exact set of the words or a Bloom filter with a given
+ * false positive rate.  Both use a fixed amount of memory; once it is
+ * exhausted, new words are no longer remembered but still cracked.
+ */
+struct dedup {
+	pthread_mutex_t lock;	/* Protects the exact set */
+	double fprate;		/* Zero for the exact set */
+	size_t memory;
+
+	/* Exact set: open addressing into an arena of words */
+	struct dedupent *table;
+	size_t tablemask;
+	char *arena;
+	size_t arenasize, arenalen;
+
+	/* Bloom filter */
+	u_int64_t *bits;
+	size_t bitmask;
+	int nhashes;
+
+	size_t entries, capacity;
+	u_int64_t removed;
+};
+
+struct dedup *dedup_new(size_t, double);
+void dedup_free(struct dedup *);
+void dedup_clear(struct dedup *);
+int dedup_seen(struct dedup *, char *);
+u_int64_t dedup_removed(struct dedup *);
+
+#endif /* _DEDUP_H_ */
@@ -102,6 +102,7 @@ struct mlist mlist;
 const char *magicfile;
 char *progname;
 int lineno;
+int noprint = 1;
 
 int main __P((int, char *[]));
 
@@ -128,6 +129,7 @@ main(argc, argv)
 #endif /* COMPILE_ONLY */
 
 
+#ifndef COMPILE_ONLY
 /*
  * Handle buf
  */
@@ -156,6 +158,7 @@ apprentice_memory(u_char *buf, u_int size)
 
 	ml->magic = magic;
 	ml->nmagic = nmagic;
+	ml->index = magindex_new(magic, nmagic);
 
 	mlist.prev->next = ml;
 	ml->prev = mlist.prev;
@@ -165,6 +168,72 @@ apprentice_memory(u_char *buf, u_int size)
 	return rv;
 }
 
+/*
+ * Handle a database written by apprentice_compile and linked into
+ * the program.  The entries are used where they are, so nothing is
+ * parsed or copied.
+ */
+int
+apprentice_compiled(uint32 *buf, u_int size)
+{
+	struct magic *magic = (struct magic *)buf;
+	uint32 nmagic, version;
+	struct mlist *ml;
+	int needsbyteswap;
+
+	mlist.next = mlist.prev = &mlist;
+
+	if (size < sizeof(struct magic)) {
+		(void)fprintf(stderr, "%s: Truncated magic database\n",
+		    progname);
+		return -1;
+	}
+	if (buf[0] != MAGICNO) {
+		if (swap4(buf[0]) != MAGICNO) {
+			(void)fprintf(stderr, "%s: Bad magic in database\n",
+			    progname);
+			return -1;
+		}
+		needsbyteswap = 1;
+	} else
+		needsbyteswap = 0;
+	if (needsbyteswap)
+		version = swap4(buf[1]);
+	else
+		version = buf[1];
+	if (version != VERSIONNO) {
+		(void)fprintf(stderr,
+		    "%s: version mismatch (%d != %d) in database\n",
+		    progname, version, VERSIONNO);
+		return -1;
+	}
+	nmagic = (size / sizeof(struct magic)) - 1;
+	magic++;
+	if (needsbyteswap)
+		byteswap(magic, nmagic);
+
+	if (nmagic == 0)
+		return 0;
+
+	if ((ml = malloc(sizeof(*ml))) == NULL) {
+		(void) fprintf(stderr, "%s: Out of memory (%s).\n", progname,
+		    strerror(errno));
+		return -1;
+	}
+
+	ml->magic = magic;
+	ml->nmagic = nmagic;
+	ml->index = magindex_new(magic, nmagic);
+
+	mlist.prev->next = ml;
+	ml->prev = mlist.prev;
+	ml->next = &mlist;
+	mlist.prev = ml;
+
+	return 0;
+}
+#endif /* COMPILE_ONLY */
+
 /*
  * Handle one file.
  */
@@ -206,6 +275,7 @@ apprentice_1(fn, action)
 
 	ml->magic = magic;
 	ml->nmagic = nmagic;
+	ml->index = magindex_new(magic, nmagic);
 
 	mlist.prev->next = ml;
 	ml->prev = mlist.prev;
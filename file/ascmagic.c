@@ -63,6 +63,8 @@ static int looks_extended __P((const unsigned char *, int, unichar *, int *));
 static void from_ebcdic __P((const unsigned char *, int, unsigned char *));
 static int ascmatch __P((const unsigned char *, const unichar *, int));
 
+extern unsigned char ebcdic_to_ascii[];
+
 int
 ascmagic(buf, nbytes)
 	unsigned char *buf;
@@ -593,6 +595,59 @@ looks_unicode(buf, nbytes, ubuf, ulen)
 	return 1;
 }
 
+/*
+ * ascmagic_test - returns 1 if ascmagic would recognize the data as
+ * some kind of text, but without converting it or looking for the
+ * subtype.  ASCII, ISO-8859 and UTF-8 text are all extended ASCII as
+ * far as text_chars is concerned, and International EBCDIC includes
+ * plain EBCDIC, so two tables decide everything but UTF-16.
+ */
+int
+ascmagic_test(buf, nbytes)
+	unsigned char *buf;
+	int nbytes;
+{
+	unichar c;
+	int i;
+
+	if (is_tar(buf, nbytes))
+		return 1;
+
+	while (nbytes > 1 && buf[nbytes - 1] == '\0')
+		nbytes--;
+
+	for (i = 0; i < nbytes; i++)
+		if (text_chars[buf[i]] == F)
+			break;
+	if (i == nbytes)
+		return 1;
+
+	if (nbytes >= 2 && ((buf[0] == 0xff && buf[1] == 0xfe) ||
+	    (buf[0] == 0xfe && buf[1] == 0xff))) {
+		for (i = 2; i + 1 < nbytes; i += 2) {
+			if (buf[0] == 0xfe)
+				c = buf[i + 1] + 256 * buf[i];
+			else
+				c = buf[i] + 256 * buf[i + 1];
+			if (c == 0xfffe)
+				break;
+			if (c < 128 && text_chars[c] != T)
+				break;
+		}
+		if (i + 1 >= nbytes)
+			return 1;
+	}
+
+	for (i = 0; i < nbytes; i++) {
+		int t = text_chars[ebcdic_to_ascii[buf[i]]];
+
+		if (t != T && t != I)
+			return 0;
+	}
+
+	return 1;
+}
+
 #undef F
 #undef T
 #undef I
@@ -111,7 +111,7 @@ file_init(void)
 {
 	int ret;
 
-	ret = apprentice_memory(magic_mem, strlen(magic_mem));
+	ret = apprentice_compiled(magic_db, magic_dbsize);
 
 	return (ret);
 }
@@ -212,6 +212,28 @@ file_process(u_char *data, int nbytes)
 	return (match);
 }
 
+/*
+ * plausible_text - tells whether process would find the data to be
+ * text, but without building the description.  Unlike process, this
+ * does not touch any global state and may be called from several
+ * threads.  The magic entries are not tried: random data matches some
+ * short binary magic about once in three hundred buffers, which is
+ * far too often for testing keys.
+ */
+int
+file_plausible_text(u_char *data, int nbytes)
+{
+	unsigned char	buf[HOWMANY+1];	/* one extra for terminating '\0' */
+
+	if (nbytes > HOWMANY)
+		nbytes = HOWMANY;
+
+	memcpy(buf, data, nbytes);
+	buf[nbytes++] = '\0';	/* null-terminate it */
+
+	return (ascmagic_test(buf, nbytes) ? 'a' : '\0');
+}
+
 
 int
 tryit(buf, nb, zflag)
@@ -32,6 +32,7 @@
 extern int   apprentice_memory(unsigned char *buf, unsigned int size);
 extern int   file_init(void);
 extern int   file_process(unsigned char *, int);
+extern int   file_plausible_text(unsigned char *, int);
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -122,6 +123,7 @@ struct magic {
 struct mlist {
 	struct magic *magic;		/* array of magic entries */
 	uint32 nmagic;			/* number of entries in array */
+	struct magindex *index;		/* candidate entries by byte value */
 	struct mlist *next, *prev;
 };
 
@@ -138,7 +140,9 @@ struct mlist {
 #endif
 
 extern int   apprentice		__P((const char *, int));
+extern int   apprentice_compiled	__P((uint32 *, unsigned int));
 extern int   ascmagic		__P((unsigned char *, int));
+extern int   ascmagic_test	__P((unsigned char *, int));
 extern void  error		__P((const char *, ...));
 extern void  ckfputs		__P((const char *, FILE *));
 struct stat;
@@ -150,6 +154,7 @@ extern void  magwarn		__P((const char *, ...));
 extern void  mdump		__P((struct magic *));
 extern void  showstr		__P((FILE *, const char *, int));
 extern int   softmagic		__P((unsigned char *, int));
+extern struct magindex *magindex_new	__P((struct magic *, uint32));
 extern int   tryit		__P((unsigned char *, int, int));
 extern int   zmagic		__P((unsigned char *, int));
 extern void  ckfprintf		__P((FILE *, const char *, ...));
@@ -169,7 +174,8 @@ extern int lflag;		/* follow symbolic links?		*/
 extern int sflag;		/* read/analyze block special files?	*/
 extern int iflag;		/* Output types as mime-types		*/
 
-extern char *magic_mem;
+extern uint32 magic_db[];	/* compiled magic, from magic.c	*/
+extern unsigned int magic_dbsize;
 
 extern int optind;		/* From getopt(3)			*/
 extern char *optarg;
@@ -1,3 +1,21 @@
-char *magic_mem =
+#include "file.h"
+
+/*
+ * The magic database, compiled by mkmagic at build time.  It is used
+ * in place by apprentice_compiled, so startup does not parse it.
+ * magic.inc lists the bytes of magic.mgc; W puts them back in file
+ * order so the strings come out right, and apprentice_compiled swaps
+ * the numbers if the build machine had the other byte order.
+ */
+#ifdef WORDS_BIGENDIAN
+#define W(a, b, c, d)	((uint32)(a) << 24 | (b) << 16 | (c) << 8 | (d))
+#else
+#define W(a, b, c, d)	((uint32)(d) << 24 | (c) << 16 | (b) << 8 | (a))
+#endif
+
+uint32 magic_db[] = {
 #include "magic.inc"
-;
+};
+#undef W
+
+unsigned int magic_dbsize = sizeof(magic_db);
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <time.h>
@@ -38,7 +39,49 @@
 FILE_RCSID("@(#)$Id: softmagic.c,v 1.1.1.1 2001/10/16 18:05:32 provos Exp $")
 #endif	/* lint */
 
-static int match	__P((struct magic *, uint32, unsigned char *, int));
+/*
+ * Most magic compares a constant with the data at a fixed offset, so
+ * the byte that the data must have at that offset is known before
+ * looking at it.  For the offsets used most often, the index keeps a
+ * bitmap of the top-level entries that can still match for each value
+ * of that byte.  The other entries are always tried, but the ones
+ * with a known byte are rejected without calling mget().
+ */
+#define MAGIC_NOFFSETS	4	/* offsets with their own bitmaps */
+#define MAGIC_NOKEY	-1
+
+struct magindex {
+	uint32 ntop;		/* number of top-level entries */
+	uint32 nwords;		/* words in each bitmap */
+	uint32 *top;		/* position of each entry in magic[] */
+	int32 *keyoff;		/* offset of the known byte or MAGIC_NOKEY */
+	unsigned char *key;	/* the known byte */
+	int noffsets;
+	int32 offsets[MAGIC_NOFFSETS];
+	uint32 *always;		/* entries not in an offset bitmap */
+	uint32 *sets;		/* bitmaps by offset and byte value */
+};
+
+#define MAGIC_SET(mi, i, c)	((mi)->sets + ((i) * 256 + (c)) * (mi)->nwords)
+#define MAGIC_BYTE(s, n, off)	((off) < (n) ? (s)[off] : 0)
+
+struct magcursor {
+	struct magic *magic;
+	uint32 nmagic;
+	struct magindex *mi;
+	unsigned char *s;
+	int nbytes;
+	uint32 *sets[MAGIC_NOFFSETS];
+	uint32 word;
+	uint32 bits;
+};
+
+static int magkey	__P((struct magic *, int32 *, unsigned char *));
+static int offcmp	__P((const void *, const void *));
+static void magcursor_init	__P((struct magcursor *, struct mlist *,
+			     unsigned char *, int));
+static int magcursor_next	__P((struct magcursor *));
+static int match	__P((struct mlist *, unsigned char *, int));
 static int mget		__P((union VALUETYPE *,
 			     unsigned char *, struct magic *, int));
 static int mcheck	__P((union VALUETYPE *, struct magic *));
@@ -62,12 +105,258 @@ softmagic(buf, nbytes)
 	struct mlist *ml;
 
 	for (ml = mlist.next; ml != &mlist; ml = ml->next)
-		if (match(ml->magic, ml->nmagic, buf, nbytes))
+		if (match(ml, buf, nbytes))
 			return 1;
 
 	return 0;
 }
 
+/*
+ * Finds the byte that the data has to have for a top-level entry to
+ * match.  Returns 0 if there is no such byte.  The index only has to
+ * be conservative: mget() and mcheck() still decide every candidate.
+ */
+static int
+magkey(m, poff, pkey)
+	struct magic *m;
+	int32 *poff;
+	unsigned char *pkey;
+{
+	uint32 l = m->value.l;
+	union {
+		uint32 l;
+		uint16 h;
+		unsigned char c;
+	} native;
+
+	if (m->reln != '=' || (m->flag & (INDIR|OFFADD)) || m->offset < 0)
+		return 0;
+	/* mcheck() matches these whatever the data */
+	if (m->value.s[0] == 'x' && m->value.s[1] == '\0')
+		return 0;
+
+	switch (m->type) {
+	case STRING:
+		/*
+		 * mconvert() may turn a trailing newline into a NUL, so
+		 * those two cannot be relied on.
+		 */
+		if (m->mask != 0 || m->vallen == 0 ||
+		    m->value.s[0] == '\0' || m->value.s[0] == '\n')
+			return 0;
+		*pkey = m->value.s[0];
+		break;
+	case BYTE:
+	case SHORT:
+	case BESHORT:
+	case LESHORT:
+	case LONG:
+	case BELONG:
+	case LELONG:
+		if (m->mask != 0 || (m->mask_op & OPINVERSE))
+			return 0;
+		switch (m->type) {
+		case BYTE:
+		case LESHORT:
+		case LELONG:
+			*pkey = l & 0xff;
+			break;
+		case BESHORT:
+			*pkey = (l >> 8) & 0xff;
+			break;
+		case BELONG:
+			*pkey = (l >> 24) & 0xff;
+			break;
+		case SHORT:
+			native.h = l;
+			*pkey = native.c;
+			break;
+		case LONG:
+			native.l = l;
+			*pkey = native.c;
+			break;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	*poff = m->offset;
+	return 1;
+}
+
+/*
+ * magindex_new - builds the index for an array of magic entries.
+ * Returns NULL if there is not enough memory, in which case all
+ * entries are tried in order.
+ */
+struct magindex *
+magindex_new(magic, nmagic)
+	struct magic *magic;
+	uint32 nmagic;
+{
+	struct magindex *mi;
+	int32 *offs = NULL, off;
+	uint32 counts[MAGIC_NOFFSETS], count, noffs, i, j, k;
+	unsigned char c;
+
+	if ((mi = calloc(1, sizeof(*mi))) == NULL)
+		return NULL;
+
+	for (i = 0; i < nmagic; i++)
+		if (magic[i].cont_level == 0)
+			mi->ntop++;
+	mi->nwords = (mi->ntop + 31) / 32;
+
+	mi->top = malloc(mi->ntop * sizeof(uint32));
+	mi->keyoff = malloc(mi->ntop * sizeof(int32));
+	mi->key = malloc(mi->ntop);
+	mi->always = calloc(mi->nwords, sizeof(uint32));
+	offs = malloc(mi->ntop * sizeof(int32));
+	if (mi->top == NULL || mi->keyoff == NULL || mi->key == NULL ||
+	    mi->always == NULL || offs == NULL)
+		goto fail;
+
+	for (i = 0, j = 0; i < nmagic; i++) {
+		if (magic[i].cont_level != 0)
+			continue;
+		mi->top[j] = i;
+		if (!magkey(&magic[i], &mi->keyoff[j], &mi->key[j]))
+			mi->keyoff[j] = MAGIC_NOKEY;
+		j++;
+	}
+
+	/* Pick the offsets with the most known bytes */
+	for (noffs = 0, j = 0; j < mi->ntop; j++)
+		if (mi->keyoff[j] != MAGIC_NOKEY)
+			offs[noffs++] = mi->keyoff[j];
+	qsort(offs, noffs, sizeof(int32), offcmp);
+	for (j = 0; j < noffs; j += count) {
+		for (count = 1; j + count < noffs; count++)
+			if (offs[j + count] != offs[j])
+				break;
+		/* Keep the offsets with the most bytes, most first */
+		for (i = mi->noffsets; i > 0 && counts[i - 1] < count; i--)
+			if (i < MAGIC_NOFFSETS) {
+				mi->offsets[i] = mi->offsets[i - 1];
+				counts[i] = counts[i - 1];
+			}
+		if (i < MAGIC_NOFFSETS) {
+			mi->offsets[i] = offs[j];
+			counts[i] = count;
+			if (mi->noffsets < MAGIC_NOFFSETS)
+				mi->noffsets++;
+		}
+	}
+	free(offs);
+	offs = NULL;
+
+	mi->sets = calloc(mi->noffsets * 256 * mi->nwords, sizeof(uint32));
+	if (mi->sets == NULL && mi->noffsets)
+		goto fail;
+
+	for (j = 0; j < mi->ntop; j++) {
+		off = mi->keyoff[j];
+		for (i = 0; i < mi->noffsets; i++)
+			if (off != MAGIC_NOKEY && mi->offsets[i] == off)
+				break;
+		if (i == mi->noffsets) {
+			mi->always[j / 32] |= (uint32)1 << (j % 32);
+			continue;
+		}
+		c = mi->key[j];
+		MAGIC_SET(mi, i, c)[j / 32] |= (uint32)1 << (j % 32);
+	}
+
+	return mi;
+
+ fail:
+	free(offs);
+	free(mi->top);
+	free(mi->keyoff);
+	free(mi->key);
+	free(mi->always);
+	free(mi);
+	return NULL;
+}
+
+static int
+offcmp(a, b)
+	const void *a, *b;
+{
+	int32 x = *(const int32 *)a, y = *(const int32 *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+static void
+magcursor_init(c, ml, s, nbytes)
+	struct magcursor *c;
+	struct mlist *ml;
+	unsigned char *s;
+	int nbytes;
+{
+	struct magindex *mi = ml->index;
+	int i;
+
+	c->magic = ml->magic;
+	c->nmagic = ml->nmagic;
+	c->mi = mi;
+	c->s = s;
+	c->nbytes = nbytes;
+	c->word = 0;
+	c->bits = 0;
+	if (mi == NULL)
+		return;
+	for (i = 0; i < mi->noffsets; i++)
+		c->sets[i] = MAGIC_SET(mi, i,
+		    MAGIC_BYTE(s, nbytes, mi->offsets[i]));
+}
+
+/*
+ * Returns the next top-level entry that might match, in the order of
+ * the magic file, or -1 when there are no more.  Without an index,
+ * every top-level entry is returned.
+ */
+static int
+magcursor_next(c)
+	struct magcursor *c;
+{
+	struct magindex *mi = c->mi;
+	int32 off;
+	uint32 j;
+	int i;
+
+	if (mi == NULL) {
+		/* c->word is the next entry in magic[] here */
+		while (c->word < c->nmagic) {
+			j = c->word++;
+			if (c->magic[j].cont_level == 0)
+				return j;
+		}
+		return -1;
+	}
+
+	for (;;) {
+		while (c->bits == 0) {
+			if (c->word >= mi->nwords)
+				return -1;
+			c->bits = mi->always[c->word];
+			for (i = 0; i < mi->noffsets; i++)
+				c->bits |= c->sets[i][c->word];
+			c->word++;
+		}
+		j = (c->word - 1) * 32 + ffs(c->bits) - 1;
+		c->bits &= c->bits - 1;
+
+		off = mi->keyoff[j];
+		if (off != MAGIC_NOKEY &&
+		    MAGIC_BYTE(c->s, c->nbytes, off) != mi->key[j])
+			continue;
+		return mi->top[j];
+	}
+}
+
 /*
  * Go through the whole list, stopping if you find a match.  Process all
  * the continuations of that match before returning.
@@ -96,12 +385,14 @@ softmagic(buf, nbytes)
  *	so that higher-level continuations are processed.
  */
 static int
-match(magic, nmagic, s, nbytes)
-	struct magic *magic;
-	uint32 nmagic;
+match(ml, s, nbytes)
+	struct mlist *ml;
 	unsigned char	*s;
 	int nbytes;
 {
+	struct magic *magic = ml->magic;
+	uint32 nmagic = ml->nmagic;
+	struct magcursor c;
 	int magindex = 0;
 	int cont_level = 0;
 	int need_separator = 0;
@@ -116,19 +407,13 @@ match(magic, nmagic, s, nbytes)
 		if ((tmpoff = (int32 *) malloc(tmplen = 20)) == NULL)
 			error("out of memory\n");
 
-	for (magindex = 0; magindex < nmagic; magindex++) {
+	/* Only the main entries that the index cannot rule out */
+	magcursor_init(&c, ml, s, nbytes);
+	while ((magindex = magcursor_next(&c)) != -1) {
 		/* if main entry matches, print it... */
 		if (!mget(&p, s, &magic[magindex], nbytes) ||
-		    !mcheck(&p, &magic[magindex])) {
-			    /* 
-			     * main entry didn't match,
-			     * flush its continuations
-			     */
-			    while (magindex < nmagic &&
-			    	   magic[magindex + 1].cont_level != 0)
-			    	   magindex++;
-			    continue;
-		}
+		    !mcheck(&p, &magic[magindex]))
+			continue;
 
 		if (! firstline) { /* we found another match */
 			/* put a newline and '-' to do some simple formatting*/
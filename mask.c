@@ -0,0 +1,265 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "config.h"
+#include "mask.h"
+
+#define MASK_SETLEN	96	/* Longest set of a position, with NUL */
+
+#define MASK_LOWER	"abcdefghijklmnopqrstuvwxyz"
+#define MASK_UPPER	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+#define MASK_DIGIT	"0123456789"
+#define MASK_SPECIAL	" !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"
+
+/*
+ * Appends the characters of the position at *pp to set, leaving out
+ * those it has already.  ?l, ?u, ?d, ?s and ?a stand for lower and
+ * upper case letters, digits, the other printable characters and all
+ * of them; ?? is a question mark, everything else itself.
+ */
+
+static int
+mask_token(char **pp, char *set)
+{
+	char *p = *pp, *chars, c[2];
+	size_t len = strlen(set);
+
+	c[1] = '\0';
+	chars = c;
+	if (p[0] == '?') {
+		switch (p[1]) {
+		case 'l':
+			chars = MASK_LOWER;
+			break;
+		case 'u':
+			chars = MASK_UPPER;
+			break;
+		case 'd':
+			chars = MASK_DIGIT;
+			break;
+		case 's':
+			chars = MASK_SPECIAL;
+			break;
+		case 'a':
+			chars = MASK_LOWER MASK_UPPER MASK_DIGIT MASK_SPECIAL;
+			break;
+		case '?':
+			c[0] = '?';
+			break;
+		default:
+			return (-1);
+		}
+		p += 2;
+	} else
+		c[0] = *p++;
+
+	for (; *chars; chars++) {
+		if (strchr(set, *chars) != NULL)
+			continue;
+		if (len >= MASK_SETLEN - 1)
+			return (-1);
+		set[len++] = *chars;
+		set[len] = '\0';
+	}
+
+	*pp = p;
+	return (0);
+}
+
+static void
+mask_count(struct mask *m)
+{
+	struct maskpart *mp;
+	int i, j;
+
+	m->count = 0;
+	for (i = 0; i < m->nparts; i++) {
+		mp = &m->parts[i];
+		mp->count = 1;
+		for (j = 0; j < mp->len; j++) {
+			if (mp->count > (u_int64_t)-1 / mp->setlens[j])
+				errx(1, "%s: too many candidates", __func__);
+			mp->count *= mp->setlens[j];
+		}
+		if (m->count > (u_int64_t)-1 - mp->count)
+			errx(1, "%s: too many candidates", __func__);
+		m->count += mp->count;
+	}
+
+	mask_seek(m, 0);
+}
+
+static struct mask *
+mask_alloc(char *spec, int nparts)
+{
+	struct mask *m;
+
+	if ((m = calloc(1, sizeof(struct mask))) == NULL)
+		err(1, "calloc");
+	if ((m->parts = calloc(nparts, sizeof(struct maskpart))) == NULL)
+		err(1, "calloc");
+	if ((m->buf = calloc(strlen(spec) + 1, MASK_SETLEN)) == NULL)
+		err(1, "calloc");
+	m->nparts = nparts;
+
+	return (m);
+}
+
+/* A mask like ?u?l?l?d, every position is one token */
+
+struct mask *
+mask_new(char *spec)
+{
+	struct mask *m;
+	struct maskpart *mp;
+	char *p = spec, *set;
+
+	m = mask_alloc(spec, 1);
+	mp = &m->parts[0];
+
+	for (set = m->buf; *p; set += MASK_SETLEN) {
+		if (mp->len >= MASK_MAXLEN)
+			errx(1, "%s: mask is too long", spec);
+		if (mask_token(&p, set) == -1)
+			errx(1, "%s: bad mask", spec);
+		mp->sets[mp->len] = set;
+		mp->setlens[mp->len++] = strlen(set);
+	}
+	if (mp->len == 0)
+		errx(1, "empty mask");
+
+	mask_count(m);
+
+	return (m);
+}
+
+/* All words from min to max characters over the tokens in spec */
+
+struct mask *
+mask_incremental(char *spec, int min, int max)
+{
+	struct mask *m;
+	struct maskpart *mp;
+	char *p = spec;
+	int i, j, len;
+
+	if (min < 1 || max < min || max > MASK_MAXLEN)
+		errx(1, "bad length: %d-%d", min, max);
+
+	m = mask_alloc(spec, max - min + 1);
+	while (*p)
+		if (mask_token(&p, m->buf) == -1)
+			errx(1, "%s: bad set of characters", spec);
+	if ((len = strlen(m->buf)) == 0)
+		errx(1, "empty set of characters");
+
+	for (i = 0; i < m->nparts; i++) {
+		mp = &m->parts[i];
+		mp->len = min + i;
+		for (j = 0; j < mp->len; j++) {
+			mp->sets[j] = m->buf;
+			mp->setlens[j] = len;
+		}
+	}
+
+	mask_count(m);
+
+	return (m);
+}
+
+void
+mask_free(struct mask *m)
+{
+	free(m->buf);
+	free(m->parts);
+	free(m);
+}
+
+/* Makes candidate n the current one */
+
+void
+mask_seek(struct mask *m, u_int64_t n)
+{
+	struct maskpart *mp;
+	int i;
+
+	for (m->part = 0; m->part < m->nparts - 1; m->part++) {
+		if (n < m->parts[m->part].count)
+			break;
+		n -= m->parts[m->part].count;
+	}
+
+	mp = &m->parts[m->part];
+	for (i = mp->len - 1; i >= 0; i--) {
+		m->idx[i] = n % mp->setlens[i];
+		n /= mp->setlens[i];
+		m->word[i] = mp->sets[i][m->idx[i]];
+	}
+	m->word[mp->len] = '\0';
+}
+
+/*
+ * Steps to the next candidate like an odometer, changing only the
+ * positions that carry.  Returns 0 after the last one.
+ */
+
+int
+mask_next(struct mask *m)
+{
+	struct maskpart *mp = &m->parts[m->part];
+	int i;
+
+	for (i = mp->len - 1; i >= 0; i--) {
+		if (++m->idx[i] < mp->setlens[i]) {
+			m->word[i] = mp->sets[i][m->idx[i]];
+			return (1);
+		}
+		m->idx[i] = 0;
+		m->word[i] = mp->sets[i][0];
+	}
+
+	if (++m->part >= m->nparts)
+		return (0);
+
+	mp = &m->parts[m->part];
+	for (i = 0; i < mp->len; i++) {
+		m->idx[i] = 0;
+		m->word[i] = mp->sets[i][0];
+	}
+	m->word[mp->len] = '\0';
+
+	return (1);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MASK_H_
+#define _MASK_H_
+
+#define MASK_MAXLEN	64	/* Longest candidate */
+
+/*
+ * Generates the candidates of a mask, which gives the characters for
+ * every position, or incrementally all words over one set of
+ * characters from a shortest to a longest length.  Both are a list of
+ * parts with a fixed length that are enumerated one after the other.
+ * Within a part, the last position changes fastest, so candidates come
+ * in the order of the sets.
+ */
+struct maskpart {
+	int len;
+	char *sets[MASK_MAXLEN];
+	int setlens[MASK_MAXLEN];
+	u_int64_t count;
+};
+
+struct mask {
+	struct maskpart *parts;
+	int nparts;
+	u_int64_t count;	/* Candidates of all parts */
+	char *buf;		/* The sets of characters */
+
+	/* The current candidate */
+	int part;
+	int idx[MASK_MAXLEN];
+	char word[MASK_MAXLEN + 1];
+};
+
+struct mask *mask_new(char *);
+struct mask *mask_incremental(char *, int, int);
+void mask_free(struct mask *);
+void mask_seek(struct mask *, u_int64_t);
+int mask_next(struct mask *);
+
+#endif /* _MASK_H_ */
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Hashes several short messages at once with MD5.  MD5 is nothing but
+ * 32-bit additions, rotations and boolean functions, so independent
+ * messages map directly onto the lanes of a vector.  The portable
+ * version computes four messages in arrays that the compiler can keep
+ * in SSE2 registers, the AVX2 version eight.  The digests are the same
+ * as from MD5Final.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "config.h"
+
+#include <md5.h>
+
+#include "md5_multi.h"
+
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#define MD5_LANES	4
+#define MD5_BLOCKS	((MD5_MULTI_MAXLEN + 9 + 63) / 64)
+
+static const u_int32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const int md5_s[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+/* Message word used by each step */
+static const int md5_g[64] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+	5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+	0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9
+};
+
+static const u_int32_t md5_iv[4] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+};
+
+/*
+ * The messages are padded into blocks of little endian words, lane by
+ * lane: m[block][word][lane].  Returns the number of blocks of the
+ * longest message.
+ */
+
+static int
+md5_multi_pad(u_int32_t (*m)[16][MD5_MULTI_MAX], int n,
+    const u_char **data, const int *lens, int *nblocks)
+{
+	u_int32_t buf[MD5_BLOCKS * 16];
+	u_int64_t bits;
+	u_char *p = (u_char *)buf;
+	int i, k, len, nw, max = 0;
+
+	for (k = 0; k < n; k++) {
+		len = lens[k];
+		nblocks[k] = (len + 8) / 64 + 1;
+		nw = nblocks[k] * 16;
+
+		memset(buf, 0, nw * sizeof(u_int32_t));
+		memcpy(p, data[k], len);
+		p[len] = 0x80;
+		bits = (u_int64_t)len << 3;
+		for (i = 0; i < 8; i++)
+			p[nw * 4 - 8 + i] = bits >> (8 * i);
+
+		for (i = 0; i < nw; i++) {
+#ifdef WORDS_BIGENDIAN
+			u_char *q = p + i * 4;
+			m[i / 16][i % 16][k] = q[0] | q[1] << 8 |
+			    q[2] << 16 | (u_int32_t)q[3] << 24;
+#else
+			m[i / 16][i % 16][k] = buf[i];
+#endif
+		}
+		if (nblocks[k] > max)
+			max = nblocks[k];
+	}
+
+	return (max);
+}
+
+static void
+md5_multi_out(u_char *digest, u_int32_t *h)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		digest[i] = h[i / 4] >> (8 * (i % 4));
+}
+
+#define MD5_ROL(x, s)	((x) << (s) | (x) >> (32 - (s)))
+
+/* Four messages in lockstep, from lane off on */
+
+static void
+md5_multi_lanes(u_char (*digest)[16], int n, u_int32_t (*m)[16][MD5_MULTI_MAX],
+    int *nblocks, int nb, int off)
+{
+	u_int32_t a[MD5_LANES], b[MD5_LANES], c[MD5_LANES], d[MD5_LANES];
+	u_int32_t h[4][MD5_LANES], f[MD5_LANES], t[MD5_LANES];
+	int blk, i, k, g, s;
+
+	for (i = 0; i < 4; i++)
+		for (k = 0; k < MD5_LANES; k++)
+			h[i][k] = md5_iv[i];
+
+	for (blk = 0; blk < nb; blk++) {
+		for (k = 0; k < MD5_LANES; k++) {
+			a[k] = h[0][k];
+			b[k] = h[1][k];
+			c[k] = h[2][k];
+			d[k] = h[3][k];
+		}
+
+		for (i = 0; i < 64; i++) {
+			g = md5_g[i];
+			s = md5_s[i];
+			for (k = 0; k < MD5_LANES; k++) {
+				if (i < 16)
+					f[k] = d[k] ^ (b[k] & (c[k] ^ d[k]));
+				else if (i < 32)
+					f[k] = c[k] ^ (d[k] & (b[k] ^ c[k]));
+				else if (i < 48)
+					f[k] = b[k] ^ c[k] ^ d[k];
+				else
+					f[k] = c[k] ^ (b[k] | ~d[k]);
+				t[k] = a[k] + f[k] + md5_k[i] + m[blk][g][off + k];
+				a[k] = d[k];
+				d[k] = c[k];
+				c[k] = b[k];
+				b[k] += MD5_ROL(t[k], s);
+			}
+		}
+
+		/* Lanes with fewer blocks keep their hash */
+		for (k = 0; k < MD5_LANES; k++) {
+			if (blk >= nblocks[off + k])
+				continue;
+			h[0][k] += a[k];
+			h[1][k] += b[k];
+			h[2][k] += c[k];
+			h[3][k] += d[k];
+		}
+	}
+
+	for (k = 0; k < MD5_LANES && off + k < n; k++) {
+		u_int32_t out[4];
+
+		for (i = 0; i < 4; i++)
+			out[i] = h[i][k];
+		md5_multi_out(digest[off + k], out);
+	}
+}
+
+#ifdef HAVE_AVX2
+#define MD5_VLANES	8
+
+#define MD5_VROL(x, s)	_mm256_or_si256(_mm256_slli_epi32(x, s), \
+			    _mm256_srli_epi32(x, 32 - (s)))
+
+/* Eight messages in the lanes of a vector */
+
+__attribute__((target("avx2")))
+static void
+md5_multi_avx2(u_char (*digest)[16], int n, u_int32_t (*m)[16][MD5_MULTI_MAX],
+    int *nblocks, int nb, int off)
+{
+	__m256i a, b, c, d, f, t, h[4], ones, mask, nbv;
+	u_int32_t out[4][MD5_VLANES];
+	int blk, i, k;
+
+	ones = _mm256_set1_epi32(-1);
+	nbv = _mm256_loadu_si256((__m256i *)(nblocks + off));
+	for (i = 0; i < 4; i++)
+		h[i] = _mm256_set1_epi32(md5_iv[i]);
+
+	for (blk = 0; blk < nb; blk++) {
+		a = h[0];
+		b = h[1];
+		c = h[2];
+		d = h[3];
+
+		for (i = 0; i < 64; i++) {
+			if (i < 16)
+				f = _mm256_xor_si256(d, _mm256_and_si256(b,
+				    _mm256_xor_si256(c, d)));
+			else if (i < 32)
+				f = _mm256_xor_si256(c, _mm256_and_si256(d,
+				    _mm256_xor_si256(b, c)));
+			else if (i < 48)
+				f = _mm256_xor_si256(b, _mm256_xor_si256(c, d));
+			else
+				f = _mm256_xor_si256(c, _mm256_or_si256(b,
+				    _mm256_xor_si256(d, ones)));
+			t = _mm256_add_epi32(_mm256_add_epi32(a, f),
+			    _mm256_add_epi32(_mm256_set1_epi32(md5_k[i]),
+			    _mm256_loadu_si256((__m256i *)
+			    &m[blk][md5_g[i]][off])));
+			a = d;
+			d = c;
+			c = b;
+			switch (md5_s[i]) {
+#define MD5_VCASE(s)	case s: t = MD5_VROL(t, s); break
+			MD5_VCASE(4); MD5_VCASE(5); MD5_VCASE(6); MD5_VCASE(7);
+			MD5_VCASE(9); MD5_VCASE(10); MD5_VCASE(11);
+			MD5_VCASE(12); MD5_VCASE(14); MD5_VCASE(15);
+			MD5_VCASE(16); MD5_VCASE(17); MD5_VCASE(20);
+			MD5_VCASE(21); MD5_VCASE(22); MD5_VCASE(23);
+#undef MD5_VCASE
+			}
+			b = _mm256_add_epi32(b, t);
+		}
+
+		/* Lanes with fewer blocks keep their hash */
+		mask = _mm256_cmpgt_epi32(nbv, _mm256_set1_epi32(blk));
+		h[0] = _mm256_add_epi32(h[0], _mm256_and_si256(a, mask));
+		h[1] = _mm256_add_epi32(h[1], _mm256_and_si256(b, mask));
+		h[2] = _mm256_add_epi32(h[2], _mm256_and_si256(c, mask));
+		h[3] = _mm256_add_epi32(h[3], _mm256_and_si256(d, mask));
+	}
+
+	for (i = 0; i < 4; i++)
+		_mm256_storeu_si256((__m256i *)out[i], h[i]);
+	for (k = 0; k < MD5_VLANES && off + k < n; k++) {
+		u_int32_t o[4];
+
+		for (i = 0; i < 4; i++)
+			o[i] = out[i][k];
+		md5_multi_out(digest[off + k], o);
+	}
+}
+#endif /* HAVE_AVX2 */
+
+/*
+ * Computes the MD5 digests of n messages, message i with lens[i] bytes
+ * at data[i].  Messages that are too long are hashed one by one.
+ */
+
+void
+md5_multi(u_char (*digest)[16], int n, const u_char **data, const int *lens)
+{
+	u_int32_t m[MD5_BLOCKS][16][MD5_MULTI_MAX];
+	int nblocks[MD5_MULTI_MAX], i, nb, lanes = MD5_LANES;
+	MD5_CTX ctx;
+
+	for (i = 0; i < n; i++)
+		if (lens[i] > MD5_MULTI_MAXLEN)
+			break;
+	if (i < n || n > MD5_MULTI_MAX) {
+		for (i = 0; i < n; i++) {
+			MD5Init(&ctx);
+			MD5Update(&ctx, (u_char *)data[i], lens[i]);
+			MD5Final(digest[i], &ctx);
+		}
+		return;
+	}
+
+	/* Lanes without a message are computed but never used */
+	memset(nblocks, 0, sizeof(nblocks));
+	nb = md5_multi_pad(m, n, data, lens, nblocks);
+
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		lanes = MD5_VLANES;
+#endif
+
+	for (i = 0; i < n; i += lanes) {
+#ifdef HAVE_AVX2
+		if (lanes == MD5_VLANES) {
+			md5_multi_avx2(digest, n, m, nblocks, nb, i);
+			continue;
+		}
+#endif
+		md5_multi_lanes(digest, n, m, nblocks, nb, i);
+	}
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "pack.h"
+
+/* Rounds up to the alignment of the index */
+#define PACK_ALIGN(x)	(((x) + 3) & ~3)
+
+static void
+pack_put64(u_int32_t *p, u_int64_t x)
+{
+	p[0] = htonl(x >> 32);
+	p[1] = htonl(x & 0xffffffff);
+}
+
+static u_int64_t
+pack_get64(u_int32_t *p)
+{
+	return ((u_int64_t)ntohl(p[0]) << 32 | ntohl(p[1]));
+}
+
+static void
+pack_write(struct pack *pk, void *buf, size_t len)
+{
+	if (write(pk->fd, buf, len) != len)
+		err(1, "write: %s", pk->name);
+	pk->off += len;
+}
+
+/*
+ * The index is kept in memory and written when the pack is finished,
+ * the header in front of the objects only then becomes valid.
+ */
+
+struct pack *
+pack_create(char *name)
+{
+	struct pack *pk;
+	struct packhdr hdr;
+
+	if ((pk = calloc(1, sizeof(struct pack))) == NULL)
+		err(1, "calloc");
+	if ((pk->name = strdup(name)) == NULL)
+		err(1, "strdup");
+
+	pk->fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (pk->fd == -1)
+		err(1, "open: %s", name);
+
+	memset(&hdr, 0, sizeof(hdr));
+	pack_write(pk, &hdr, sizeof(hdr));
+
+	return (pk);
+}
+
+void
+pack_add(struct pack *pk, char *name, int type, u_char *buf, size_t len)
+{
+	struct packent *ent;
+	size_t namelen = strlen(name) + 1;
+
+	if (pk->nents >= pk->entsize) {
+		pk->entsize = pk->entsize ? 2 * pk->entsize : 1024;
+		pk->ents = realloc(pk->ents,
+		    pk->entsize * sizeof(struct packent));
+		if (pk->ents == NULL)
+			err(1, "realloc");
+	}
+	while (pk->namelen + namelen > pk->namesize) {
+		pk->namesize = pk->namesize ? 2 * pk->namesize : 65536;
+		if ((pk->names = realloc(pk->names, pk->namesize)) == NULL)
+			err(1, "realloc");
+	}
+
+	/* Name offsets are relative to the names until the end */
+	ent = &pk->ents[pk->nents++];
+	ent->type = htonl(type);
+	ent->len = htonl(len);
+	pack_put64(ent->name, pk->namelen);
+	pack_put64(ent->off, pk->off);
+
+	memcpy(pk->names + pk->namelen, name, namelen);
+	pk->namelen += namelen;
+
+	pack_write(pk, buf, len);
+}
+
+void
+pack_finish(struct pack *pk)
+{
+	struct packhdr hdr;
+	struct packent *ent;
+	u_int64_t names;
+	size_t len;
+	int i;
+
+	/* Pads the names so that the index is aligned */
+	names = pk->off;
+	len = PACK_ALIGN(names + pk->namelen) - names;
+	if ((pk->names = realloc(pk->names, len + 1)) == NULL)
+		err(1, "realloc");
+	memset(pk->names + pk->namelen, 0, len - pk->namelen);
+	pack_write(pk, pk->names, len);
+
+	for (i = 0; i < pk->nents; i++) {
+		ent = &pk->ents[i];
+		pack_put64(ent->name, names + pack_get64(ent->name));
+	}
+
+	memcpy(hdr.magic, PACK_MAGIC, sizeof(hdr.magic));
+	hdr.version = htonl(PACK_VERSION);
+	hdr.count = htonl(pk->nents);
+	pack_put64(hdr.index, pk->off);
+	pack_write(pk, pk->ents, pk->nents * sizeof(struct packent));
+
+	if (lseek(pk->fd, 0, SEEK_SET) == -1 ||
+	    write(pk->fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+		err(1, "write: %s", pk->name);
+	if (close(pk->fd) == -1)
+		err(1, "close: %s", pk->name);
+
+	free(pk->ents);
+	free(pk->names);
+	free(pk->name);
+	free(pk);
+}
+
+/*
+ * Maps a pack, or reads it at once if it cannot be mapped.  The
+ * entries are checked only when they are used.
+ */
+
+struct pack *
+pack_open(char *name)
+{
+	struct pack *pk;
+	struct packhdr *hdr;
+	struct stat sb;
+	u_int64_t index;
+	ssize_t n;
+
+	if ((pk = calloc(1, sizeof(struct pack))) == NULL)
+		err(1, "calloc");
+	if ((pk->name = strdup(name)) == NULL)
+		err(1, "strdup");
+
+	if ((pk->fd = open(name, O_RDONLY, 0)) == -1) {
+		warn("open: %s", name);
+		goto error;
+	}
+	if (fstat(pk->fd, &sb) == -1) {
+		warn("fstat: %s", name);
+		goto error;
+	}
+	if (sb.st_size < sizeof(struct packhdr) ||
+	    sb.st_size != (size_t)sb.st_size) {
+		warnx("%s: not a pack", name);
+		goto error;
+	}
+	pk->size = sb.st_size;
+
+	pk->data = mmap(NULL, pk->size, PROT_READ, MAP_PRIVATE, pk->fd, 0);
+	if (pk->data != MAP_FAILED)
+		pk->mapped = 1;
+	else {
+		if ((pk->data = malloc(pk->size)) == NULL)
+			err(1, "malloc");
+		n = read(pk->fd, pk->data, pk->size);
+		if (n != pk->size) {
+			warn("read: %s", name);
+			goto error;
+		}
+	}
+	close(pk->fd);
+	pk->fd = -1;
+
+	hdr = (struct packhdr *)pk->data;
+	pk->count = ntohl(hdr->count);
+	index = pack_get64(hdr->index);
+	if (memcmp(hdr->magic, PACK_MAGIC, sizeof(hdr->magic)) ||
+	    ntohl(hdr->version) != PACK_VERSION ||
+	    index > pk->size || (index & 3) ||
+	    pk->count > (pk->size - index) / sizeof(struct packent)) {
+		warnx("%s: not a pack", name);
+		goto error;
+	}
+	pk->index = (struct packent *)(pk->data + index);
+
+	return (pk);
+
+ error:
+	pack_close(pk);
+	return (NULL);
+}
+
+/* Returns the i-th entry, or -1 if it points outside of the pack */
+
+int
+pack_entry(struct pack *pk, int i, int *ptype, char **pname,
+    u_char **pbuf, size_t *plen)
+{
+	struct packent *ent = &pk->index[i];
+	u_int64_t name, off, len;
+
+	name = pack_get64(ent->name);
+	off = pack_get64(ent->off);
+	len = ntohl(ent->len);
+
+	if (name >= pk->size ||
+	    memchr(pk->data + name, '\0', pk->size - name) == NULL ||
+	    off > pk->size || len > pk->size - off)
+		return (-1);
+
+	*ptype = ntohl(ent->type);
+	*pname = (char *)pk->data + name;
+	*pbuf = pk->data + off;
+	*plen = len;
+
+	return (0);
+}
+
+void
+pack_close(struct pack *pk)
+{
+	if (pk->mapped)
+		munmap(pk->data, pk->size);
+	else
+		free(pk->data);
+	if (pk->fd != -1)
+		close(pk->fd);
+	free(pk->name);
+	free(pk);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PACK_H_
+#define _PACK_H_
+
+#define PACK_EXTENSION	".pack"
+#define PACK_MAGIC	"STEGPACK"
+#define PACK_VERSION	1
+
+/*
+ * A pack holds the converted objects of many images in one file.
+ * After the header come the objects, then the names of the images and
+ * last an index with an entry for every object.  Numbers are stored
+ * in network byte order, offsets are from the start of the file.
+ * They are 64 bits, split into two halves, since a pack of many
+ * images can grow past 4 GB.
+ */
+struct packhdr {
+	char magic[8];
+	u_int32_t version;
+	u_int32_t count;	/* Entries in the index */
+	u_int32_t index[2];	/* Offset of the index */
+};
+
+struct packent {
+	u_int32_t type;		/* Type of the object, as in stegbreak */
+	u_int32_t len;
+	u_int32_t name[2];	/* Offset of the name of its image */
+	u_int32_t off[2];	/* Offset of the object */
+};
+
+struct pack {
+	char *name;
+	int fd;
+
+	/* Used while writing */
+	u_int64_t off;
+	struct packent *ents;
+	int nents, entsize;
+	char *names;
+	size_t namelen, namesize;
+
+	/* Used while reading */
+	u_char *data;
+	size_t size;
+	int mapped;
+	u_int32_t count;
+	struct packent *index;
+};
+
+struct pack *pack_create(char *);
+void pack_add(struct pack *, char *, int, u_char *, size_t);
+void pack_finish(struct pack *);
+
+struct pack *pack_open(char *);
+int pack_entry(struct pack *, int, int *, char **, u_char **, size_t *);
+void pack_close(struct pack *);
+
+#endif /* _PACK_H_ */
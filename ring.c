@@ -0,0 +1,185 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bounded lock-free queue of pointers for several producers and
+ * consumers.  Every cell carries a sequence number that tells whether
+ * it is ready to be written or read at a given position, so producers
+ * and consumers only contend on their own position counter.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <err.h>
+
+#include "config.h"
+#include "ring.h"
+
+/* Keeps the two position counters on different cache lines */
+#define RING_PAD	64
+
+struct ringcell {
+	u_long seq;
+	void *data;
+};
+
+struct ring {
+	struct ringcell *cells;
+	u_long mask;
+
+	char pad0[RING_PAD];
+	u_long putpos;
+	char pad1[RING_PAD];
+	u_long getpos;
+	char pad2[RING_PAD];
+};
+
+/* Size is rounded up to a power of two */
+
+struct ring *
+ring_new(int size)
+{
+	struct ring *ring;
+	u_long i, n;
+
+	for (n = 1; n < size; n <<= 1)
+		;
+
+	if ((ring = calloc(1, sizeof(struct ring))) == NULL)
+		err(1, "calloc");
+	if ((ring->cells = calloc(n, sizeof(struct ringcell))) == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < n; i++)
+		ring->cells[i].seq = i;
+	ring->mask = n - 1;
+
+	return (ring);
+}
+
+void
+ring_free(struct ring *ring)
+{
+	free(ring->cells);
+	free(ring);
+}
+
+/* Returns -1 if the ring is full */
+
+int
+ring_put(struct ring *ring, void *data)
+{
+	struct ringcell *cell;
+	u_long pos, seq;
+	long dif;
+
+	pos = __atomic_load_n(&ring->putpos, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		dif = (long)seq - (long)pos;
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ring->putpos,
+				&pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0)
+			return (-1);
+		else
+			pos = __atomic_load_n(&ring->putpos, __ATOMIC_RELAXED);
+	}
+
+	cell->data = data;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return (0);
+}
+
+/* Returns NULL if the ring is empty */
+
+void *
+ring_get(struct ring *ring)
+{
+	struct ringcell *cell;
+	u_long pos, seq;
+	long dif;
+	void *data;
+
+	pos = __atomic_load_n(&ring->getpos, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		dif = (long)seq - (long)(pos + 1);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ring->getpos,
+				&pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0)
+			return (NULL);
+		else
+			pos = __atomic_load_n(&ring->getpos, __ATOMIC_RELAXED);
+	}
+
+	data = cell->data;
+	__atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+	return (data);
+}
+
+/*
+ * Called in a loop while waiting for another thread.  Yields a few
+ * times first, then sleeps for up to 10 ms so that idle threads do
+ * not take CPU away from the crackers.
+ */
+
+void
+ring_backoff(int *tries)
+{
+	if (++*tries < 16)
+		sched_yield();
+	else
+		usleep(*tries < 64 ? 100 : 10000);
+}
+
+void *
+ring_get_wait(struct ring *ring)
+{
+	void *data;
+	int tries = 0;
+
+	while ((data = ring_get(ring)) == NULL)
+		ring_backoff(&tries);
+
+	return (data);
+}
@@ -22,7 +22,7 @@
 
 #define ARCH_WORD		u_int32_t
 #define ARCH_BITS		32
-#define ARCH_INDEX		u_int32_t
+#define ARCH_INDEX		u_char
 
 /*
  * Character range.
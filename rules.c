@@ -24,7 +24,6 @@ char *rules_errors[] = {
 
 int rules_errno, rules_line;
 
-int rules_debug;
 char *rules_classes[0x100], rules_length[0x100];
 int rules_max_length = 0;
 
@@ -64,61 +63,6 @@ char *conv_tolower, *conv_toupper;
 #define LAST				(*(rule - 1))
 #define NEXT				(*rule)
 
-#define REJECT { \
-	if (!rules_debug) return (NULL); \
-}
-
-#define VALUE { \
-	if (!(value = RULE)) { \
-		rules_errno = RULES_ERROR_END; \
-		return (NULL); \
-	} \
-}
-
-#define POSITION { \
-	if ((pos = rules_length[(ARCH_INDEX)RULE]) == INVALID_LENGTH) { \
-		if (LAST) \
-			rules_errno = RULES_ERROR_POSITION; \
-		else \
-			rules_errno = RULES_ERROR_END; \
-		return (NULL); \
-	} \
-}
-
-#define CLASS(start, true, false) { \
-	if ((value = RULE) == '?') { \
-		if (!(class = rules_classes[(ARCH_INDEX)RULE])) { \
-			if (LAST) \
-				rules_errno = RULES_ERROR_CLASS; \
-			else \
-				rules_errno = RULES_ERROR_END; \
-			return (NULL); \
-		} \
-		for (pos = (start); (ARCH_INDEX)in[pos]; pos++) \
-		if (class[(ARCH_INDEX)in[pos]]) { \
-			true; \
-		} else { \
-			false; \
-		} \
-	} else { \
-		if (!value) { \
-			rules_errno = RULES_ERROR_END; \
-			return (NULL); \
-		} \
-		for (pos = (start); (ARCH_INDEX)in[pos]; pos++) \
-		if (in[pos] == value) { \
-			true; \
-		} else { \
-			false; \
-		} \
-	} \
-}
-
-#define SKIP_CLASS { \
-	VALUE \
-	if (value == '?') VALUE \
-}
-
 #define CONV(conv) { \
 	for (pos = 0; (out[pos] = (conv)[(ARCH_INDEX)in[pos]]); pos++); \
 }
@@ -212,7 +156,6 @@ void rules_init(int max_length)
 	rules_init_convs();
 	rules_init_length(max_length);
 
-	rules_debug = 0;
 	rules_errno = RULES_ERROR_NONE;
 }
 
@@ -263,41 +206,288 @@ char *rules_reject(char *rule, void *db)
 	return (rule - 1);
 }
 
-char *
-rules_apply(char *word, char *rule, int split)
+/*
+ * Rule compiler.  The argument characters of each command are decoded
+ * once, so that applying a rule to a word does not parse the rule
+ * again.  Leading length tests are folded into a length range that is
+ * checked before the word is copied, and leading commands that only
+ * test the word run on the caller's string.
+ */
+
+#define OP_CLASS(start, true, false) { \
+	if ((class = op->class) != NULL) { \
+		for (pos = (start); (ARCH_INDEX)in[pos]; pos++) \
+		if (class[(ARCH_INDEX)in[pos]]) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} else { \
+		for (pos = (start); (ARCH_INDEX)in[pos]; pos++) \
+		if (in[pos] == op->cvalue) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} \
+}
+
+static int
+rules_compile_pos(char **prule, int *pos)
 {
-	static char buffer[3][RULE_WORD_SIZE * 2];
-	char *in = buffer[0], *out = buffer[1];
-	char memory[RULE_WORD_SIZE];
-	int memory_empty, which;
-	char value, *class;
-	int pos, out_pos;
-	int count, required;
+	char *rule = *prule;
 
-	strncpy(in, word, RULE_WORD_SIZE);
-	memory_empty = 1; which = 0;
+	if ((*pos = rules_length[(ARCH_INDEX)RULE]) == INVALID_LENGTH) {
+		if (LAST)
+			rules_errno = RULES_ERROR_POSITION;
+		else
+			rules_errno = RULES_ERROR_END;
+		return (-1);
+	}
+
+	*prule = rule;
+	return (0);
+}
+
+static int
+rules_compile_value(char **prule, char *value)
+{
+	char *rule = *prule;
+
+	if (!(*value = RULE)) {
+		rules_errno = RULES_ERROR_END;
+		return (-1);
+	}
+
+	*prule = rule;
+	return (0);
+}
+
+static int
+rules_compile_class(char **prule, struct rules_op *op)
+{
+	char *rule = *prule;
+	char value;
+
+	if ((value = RULE) == '?') {
+		if (!(op->class = rules_classes[(ARCH_INDEX)RULE])) {
+			if (LAST)
+				rules_errno = RULES_ERROR_CLASS;
+			else
+				rules_errno = RULES_ERROR_END;
+			return (-1);
+		}
+	} else {
+		if (!value) {
+			rules_errno = RULES_ERROR_END;
+			return (-1);
+		}
+		op->class = NULL;
+		op->cvalue = value;
+	}
+
+	*prule = rule;
+	return (0);
+}
+
+int
+rules_compile(struct rules_prog *prog, char *rule, int split)
+{
+	struct rules_op *op;
+	int pos, hoist = 1;
+
+	memset(prog, 0, sizeof(*prog));
+	prog->maxlen = RULE_WORD_SIZE;
+
+	if ((rule = rules_reject(rule, NULL)) == NULL)
+		return (-1);
+
+	if (!NEXT || (NEXT == ':' && !*(rule + 1))) {
+		prog->noop = 1;
+		return (0);
+	}
+
+	/* Every command rejects the empty word */
+	prog->minlen = 1;
 
-	if (NEXT != ':' || *(rule + 1))
 	while (RULE) {
-		if (!in[0]) REJECT
-		in[RULE_WORD_SIZE - 1] = 0;
+		op = &prog->ops[prog->nops];
+		op->cmd = LAST;
 
-		switch (LAST) {
-/* Crack v4.1 rules */
+		switch (op->cmd) {
 		case ':':
 		case ' ':
 		case '\t':
-			out = in;
+			continue;
+
+		case '<':
+		case '>':
+			if (rules_compile_pos(&rule, &pos) == -1)
+				return (-1);
+			if (hoist) {
+				if (op->cmd == '<' && pos - 1 < prog->maxlen)
+					prog->maxlen = pos - 1;
+				if (op->cmd == '>' && pos + 1 > prog->minlen)
+					prog->minlen = pos + 1;
+				continue;
+			}
+			op->pos = pos;
+			break;
+
+		case '$':
+		case '^':
+			if (rules_compile_value(&rule, &op->value) == -1)
+				return (-1);
+			break;
+
+		case 'x':
+			if (rules_compile_pos(&rule, &op->pos) == -1 ||
+			    rules_compile_pos(&rule, &op->pos2) == -1)
+				return (-1);
+			break;
+
+		case 'i':
+		case 'o':
+			if (rules_compile_pos(&rule, &op->pos) == -1 ||
+			    rules_compile_value(&rule, &op->value) == -1)
+				return (-1);
+			break;
+
+		case 's':
+			if (rules_compile_class(&rule, op) == -1 ||
+			    rules_compile_value(&rule, &op->value) == -1)
+				return (-1);
+			break;
+
+		case '@':
+		case '!':
+		case '/':
+		case '(':
+		case ')':
+			if (rules_compile_class(&rule, op) == -1)
+				return (-1);
+			break;
+
+		case '=':
+		case '%':
+			if (rules_compile_pos(&rule, &op->pos) == -1 ||
+			    rules_compile_class(&rule, op) == -1)
+				return (-1);
+			break;
+
+		case 'T':
+		case 'D':
+		case '\'':
+			if (rules_compile_pos(&rule, &op->pos) == -1)
+				return (-1);
+			break;
+
+		case 'l': case 'u': case 'c': case 'r': case 'd': case 'f':
+		case 'p': case '[': case ']': case 'C': case 't': case '{':
+		case '}': case 'S': case 'V': case 'R': case 'L': case 'P':
+		case 'I': case 'M': case 'Q': case '+':
+			break;
+
+		case '1':
+		case '2':
+			if (split < 0) {
+				rules_errno = RULES_ERROR_UNKNOWN;
+				return (-1);
+			}
 			break;
 
+		default:
+			rules_errno = RULES_ERROR_UNKNOWN;
+			return (-1);
+		}
+
+		/* Tests leave the word alone and can run on the input */
+		switch (op->cmd) {
+		case '<': case '>': case '!': case '/': case '(': case ')':
+		case '=': case '%':
+			if (hoist)
+				prog->ntests++;
+			break;
+		default:
+			hoist = 0;
+			break;
+		}
+
+		prog->nops++;
+	}
+
+	return (0);
+}
+
+/*
+ * Applies a compiled rule to a word.  Everything the rule needs is in
+ * the program and the caller's buffer, so several threads can apply
+ * rules at the same time.
+ */
+
+char *
+rules_execute(char *word, struct rules_prog *prog, int split,
+    char buffer[3][RULE_WORD_SIZE * 2])
+{
+	struct rules_op *op, *end;
+	char *in, *out;
+	char memory[RULE_WORD_SIZE];
+	int memory_empty, which, testing;
+	char *class;
+	int len, pos, out_pos;
+	int count, required;
+
+	if (prog->noop) {
+		strncpy(buffer[0], word, RULE_WORD_SIZE);
+		buffer[0][rules_max_length] = 0;
+		return (buffer[0]);
+	}
+
+	memory_empty = 1; which = 0;
+	out = buffer[1];
+
+	if (prog->nops && !prog->ntests && prog->minlen <= 1 &&
+	    prog->maxlen >= RULE_WORD_SIZE - 1) {
+		/* Nothing to check up front */
+		strncpy(buffer[0], word, RULE_WORD_SIZE);
+		in = buffer[0];
+		testing = 0;
+	} else {
+		/* Tests run on the input word, unless it is truncated */
+		in = word;
+		len = strlen(word);
+		if (len >= RULE_WORD_SIZE) {
+			strncpy(buffer[0], word, RULE_WORD_SIZE);
+			buffer[0][RULE_WORD_SIZE - 1] = 0;
+			in = buffer[0];
+			len = RULE_WORD_SIZE - 1;
+		}
+		if (len < prog->minlen || len > prog->maxlen)
+			return (NULL);
+		testing = 1;
+	}
+
+	end = &prog->ops[prog->nops];
+	for (op = &prog->ops[0]; op < end; op++) {
+		if (testing && op == &prog->ops[prog->ntests]) {
+			if (in != buffer[0])
+				strncpy(buffer[0], in, RULE_WORD_SIZE);
+			in = buffer[0];
+			out = buffer[1];
+			testing = 0;
+		}
+
+		if (!in[0]) return (NULL);
+		if (!testing)
+			in[RULE_WORD_SIZE - 1] = 0;
+
+		switch (op->cmd) {
 		case '<':
-			POSITION
-			if ((int)strlen(in) < pos) out = in; else REJECT
+			if ((int)strlen(in) < op->pos) out = in; else return (NULL);
 			break;
 
 		case '>':
-			POSITION
-			if ((int)strlen(in) > pos) out = in; else REJECT
+			if ((int)strlen(in) > op->pos) out = in; else return (NULL);
 			break;
 
 		case 'l':
@@ -355,85 +545,70 @@ rules_apply(char *word, char *rule, int split)
 			break;
 
 		case '$':
-			VALUE
 			out = in;
-			out[pos = strlen(out)] = value;
+			out[pos = strlen(out)] = op->value;
 			out[pos + 1] = 0;
 			break;
 
 		case '^':
-			VALUE
-			out[0] = value;
+			out[0] = op->value;
 			strcpy(&out[1], in);
 			break;
 
 		case 'x':
-			POSITION
-			if (pos < (int)strlen(in)) {
-				in += pos;
-				POSITION
-				strlcpy(out, in, pos + 1);
-			} else {
-				POSITION
+			if (op->pos < (int)strlen(in))
+				strlcpy(out, in + op->pos, op->pos2 + 1);
+			else
 				out[0] = 0;
-			}
 			break;
 
 		case 'i':
-			POSITION
-			VALUE
+			pos = op->pos;
 			if (pos < (out_pos = strlen(in))) {
 				memcpy(out, in, pos);
-				out[pos] = value;
+				out[pos] = op->value;
 				strcpy(&out[pos + 1], &in[pos]);
 			} else {
 				out = in;
-				out[out_pos] = value;
+				out[out_pos] = op->value;
 				out[out_pos + 1] = 0;
 			}
 			break;
 
 		case 'o':
-			POSITION
-			VALUE
 			out = in;
-			if (out[pos]) out[pos] = value;
+			if (out[op->pos]) out[op->pos] = op->value;
 			break;
 
 		case 's':
 			out = in;
-			CLASS(0, out[pos] = NEXT, {})
-			VALUE
+			OP_CLASS(0, out[pos] = op->value, {})
 			break;
 
 		case '@':
 			out_pos = 0;
-			CLASS(0, {}, out[out_pos++] = in[pos])
+			OP_CLASS(0, {}, out[out_pos++] = in[pos])
 			out[out_pos] = 0;
 			break;
 
 		case '!':
-			CLASS(0, REJECT, {})
+			OP_CLASS(0, return (NULL), {})
 			out = in;
 			break;
 
 		case '/':
-			CLASS(0, break, {})
-			if (!in[pos]) REJECT
+			OP_CLASS(0, break, {})
+			if (!in[pos]) return (NULL);
 			out = in;
 			break;
 
 		case '=':
-			POSITION
-			if (pos >= (int)strlen(in)) {
-				SKIP_CLASS
-				REJECT
-			} else
-				CLASS(pos, break, REJECT)
+			if (op->pos >= (int)strlen(in))
+				return (NULL);
+			OP_CLASS(op->pos, break, return (NULL))
 			out = in;
 			break;
 
-/* Crack v5.0 rules */
 		case '[':
 			if (in[0]) strcpy(out, &in[1]); else out[0] = 0;
 			break;
@@ -458,41 +633,33 @@ rules_apply(char *word, char *rule, int split)
 			break;
 
 		case '(':
-			CLASS(0, break, REJECT)
+			OP_CLASS(0, break, return (NULL))
 			out = in;
 			break;
 
 		case ')':
-			if (!in[0]) {
-				SKIP_CLASS
-				REJECT
-			} else
-				CLASS(strlen(in) - 1, break, REJECT)
+			OP_CLASS(strlen(in) - 1, break, return (NULL))
 			out = in;
 			break;
 
 		case '\'':
-			POSITION
-			(out = in)[pos] = 0;
+			(out = in)[op->pos] = 0;
 			break;
 
 		case '%':
-			POSITION
-			count = 0; required = pos;
-			CLASS(0, if (++count >= required) break, {})
-			if (count < required) REJECT
+			count = 0; required = op->pos;
+			OP_CLASS(0, if (++count >= required) break, {})
+			if (count < required) return (NULL);
 			out = in;
 			break;
 
-/* Rules added in John */
 		case 'T':
-			POSITION
 			out = in;
-			out[pos] = conv_invert[(ARCH_INDEX)out[pos]];
+			out[op->pos] = conv_invert[(ARCH_INDEX)out[op->pos]];
 			break;
 
 		case 'D':
-			POSITION
+			pos = op->pos;
 			if (pos >= (int)strlen(in)) out = in; else {
 				memcpy(out, in, pos);
 				strcpy(&out[pos], &in[pos + 1]);
@@ -574,20 +741,15 @@ rules_apply(char *word, char *rule, int split)
 		case 'Q':
 			if (memory_empty) {
 				if (!strncmp(word, in, rules_max_length))
-					REJECT
+					return (NULL);
 			} else
 				if (!strncmp(memory, in, rules_max_length))
-					REJECT
+					return (NULL);
 			out = in;
 			break;
 
-/* Additional "single crack" mode rules */
 		case '1':
-			if (split < 0) {
-				rules_errno = RULES_ERROR_UNKNOWN;
-				return (NULL);
-			}
-			if (!split) REJECT
+			if (!split) return (NULL);
 			if (which) strcpy(buffer[2], in);
 			else strlcpy(buffer[2], &word[split], RULE_WORD_SIZE);
 			strlcpy(out, word, split + 1);
@@ -595,11 +757,7 @@ rules_apply(char *word, char *rule, int split)
 			break;
 
 		case '2':
-			if (split < 0) {
-				rules_errno = RULES_ERROR_UNKNOWN;
-				return (NULL);
-			}
-			if (!split) REJECT
+			if (!split) return (NULL);
 			if (which) strcpy(buffer[2], in);
 			else strlcpy(buffer[2], word, split + 1);
 			strlcpy(out, &word[split], RULE_WORD_SIZE);
@@ -623,13 +781,13 @@ rules_apply(char *word, char *rule, int split)
 			}
 			which = 0;
 			break;
-
-		default:
-			rules_errno = RULES_ERROR_UNKNOWN;
-			return (NULL);
 		}
 
-		if (!out[0]) REJECT
+		if (!out[0]) return (NULL);
+
+		/* Tests set out to the input, which stays where it is */
+		if (testing)
+			continue;
 
 		if ((in = out) == buffer[1])
 			out = buffer[0];
@@ -637,6 +795,13 @@ rules_apply(char *word, char *rule, int split)
 			out = buffer[1];
 	}
 
+	if (testing) {
+		if (in != buffer[0])
+			strncpy(buffer[0], in, RULE_WORD_SIZE);
+		in = buffer[0];
+		out = buffer[1];
+	}
+
 	switch (which) {
 	case 1:
 		strcat(in, buffer[2]);
@@ -655,6 +820,7 @@ rules_apply(char *word, char *rule, int split)
 int rules_check(struct rpp_context *start, int split)
 {
 	struct rpp_context ctx;
+	struct rules_prog prog;
 	char *rule;
 	int count;
 
@@ -664,16 +830,12 @@ int rules_check(struct rpp_context *start, int split)
 	rules_line = ctx.input->number;
 	count = 0;
 
-	rules_debug = 1;
-	while ((rule = rpp_next(&ctx)))
-	if ((rule = rules_reject(rule, NULL))) {
-		rules_apply("", rule, split);
-		if (rules_errno) break;
+	while ((rule = rpp_next(&ctx))) {
+		if (rules_compile(&prog, rule, split)) break;
 
 		if (ctx.input) rules_line = ctx.input->number;
 		count++;
 	}
-	rules_debug = 0;
 
 	return (rules_errno ? 0 : count);
 }
@@ -55,14 +55,42 @@ extern void rules_init(int max_length);
 extern char *rules_reject(char *rule, void *db);
 
 /*
- * Applies rule to a word. Returns the updated word, or NULL if rejected or
- * an error occured. Also sets rules_errno on error.
+ * A rule compiled by rules_compile().  Each command has its position,
+ * character and class arguments decoded.
+ */
+struct rules_op {
+	char cmd;
+	char value;		/* Character argument */
+	char cvalue;		/* Single character instead of a class */
+	char *class;		/* Character class or NULL */
+	int pos, pos2;		/* Position arguments */
+};
+
+struct rules_prog {
+	int noop;		/* Rule does not change the word */
+	int minlen, maxlen;	/* Accepted lengths of the input word */
+	int ntests;		/* Leading ops that only test the word */
+	int nops;
+	struct rules_op ops[RULE_BUFFER_SIZE];
+};
+
+/*
+ * Compiles a rule, including its reject flags.  Returns zero, or -1 and
+ * sets rules_errno if the rule is rejected or invalid.
  *
  * split > 0	"single crack" mode, split is the second word's position
  * split == 0	"single crack" mode, only one word
  * split < 0	other cracking modes, "single crack" mode rules are invalid
  */
-extern char *rules_apply(char *word, char *rule, int split);
+extern int rules_compile(struct rules_prog *prog, char *rule, int split);
+
+/*
+ * Applies a compiled rule to a word in the caller's buffer.  Returns the
+ * updated word, or NULL if the rule rejects it.  split is the same as
+ * for rules_compile().
+ */
+extern char *rules_execute(char *word, struct rules_prog *prog, int split,
+    char buffer[3][RULE_WORD_SIZE * 2]);
 
 /*
  * Checks if all the rules for context are valid. Returns the number of rules,
@@ -32,14 +32,19 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/queue.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <signal.h>
 #include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <jpeglib.h>
 #include <file.h>
@@ -51,7 +56,14 @@
 #include "break_jphide.h"
 #include "break_outguess.h"
 #include "break_jsteg.h"
+#include "ring.h"
 #include "db.h"
+#include "wordlist.h"
+#include "dedup.h"
+#include "mask.h"
+#include "arc4.h"
+#include "pack.h"
+#include "walk.h"
 
 #ifndef PATH_MAX
 #define PATH_MAX	1024
@@ -61,63 +73,158 @@
 #define FLAG_DOJPHIDE	0x0002
 #define FLAG_DOJSTEG	0x0004
 
+#define LINE_BATCH	256	/* Wordlist lines handed to a producer */
+#define KEYSPACE_MAX	0xffffffffffULL	/* Largest 40-bit jsteg key */
+#define DEFAULT_MEMORY	1024	/* Megabytes for loaded images */
+#define CHECKPOINT_INTERVAL	300	/* Seconds between checkpoints */
+#define CHECKPOINT_LINES	4096	/* Lines between looking at the clock */
+#define CONVERT_MAXLEN	32768	/* Larger than any converted object */
+
+/*
+ * A converted object that a worker sends to the parent, followed by
+ * the name of its image and the object.  Without a type, the image is
+ * done and has been loaded or converted.
+ */
+struct workrec {
+	int type;
+	int namelen;
+	int len;
+};
+
+/* Lines from the wordlist and the rule that the producers apply */
+struct linebatch {
+	int nlines;
+	char rule[RULE_BUFFER_SIZE];
+	char lines[LINE_BATCH][RULE_WORD_SIZE];
+};
+
 char *rules_name;
 char *progname;
 char *wordlist = "/usr/share/dict/words";
 
 int convert = 0;
+char *packname;			/* File given with -p */
+struct pack *pack;
+int worker_fd = -1;		/* Pipe to the parent of a worker */
 int quiet = 0;
+int nthreads = 1;
 int alarmed = 0;
 int signaled = 0;
-FILE *word_file;
-int line_number, rule_number, rule_count;
+struct wordlist *words;
+struct wordpos wordpos;
+struct dedup *dedup;
+int keyspace = 0;
+struct mask *mask;		/* Candidates from -a or -i */
+u_int64_t key_start, key_end = KEYSPACE_MAX;
+size_t maxmemory = (size_t)DEFAULT_MEMORY << 20;
+int shard, nshards = 1;		/* This process tries shard of nshards */
+int merge = 0;
 
-u_int32_t count, total_count;
-int found = 0;
+/*
+ * Checkpoints.  Images from attacks that have finished are done, the
+ * others loaded.  A resumed run first cracks the loaded images from the
+ * saved position and then the images that are neither.
+ */
+#define RESUME_NONE	0
+#define RESUME_LOADED	1	/* Only images that were loaded */
+#define RESUME_REST	2	/* Only images that were not */
+
+char *checkpoint;		/* File given with -R */
+time_t next_checkpoint;
+int terminated = 0;
+char **donefiles;		/* Done and, after ndone, being cracked */
+int ndone, ndonefiles, donesize;
+int resume = RESUME_NONE;
+char **resume_loaded;
+int nresume_loaded, nresume_done;
+int resume_rule;		/* Position of the attack on loaded images */
+size_t resume_word, resume_nwords;
+u_int64_t resume_key;
+u_int64_t resume_candidate, resume_ncandidates;
+int rule_number, rule_count;
+
+u_int32_t last_count;
 struct timeval last_tv;
 time_t starttime;
 
-void
-status_print(char *word)
+struct ring *linering, *linefreering;
+struct linebatch *curlines;
+u_long lines_submitted, lines_done;
+
+/* Cracks per second since the last status */
+
+float
+status_rate(void)
 {
-	struct stat stat;
-	long where;
-	int part_file;
 	struct timeval tv, rtv;
+	u_int32_t count;
 	float rate = 0;
 
-	if (!word_file || word_file == stdin) {
-		fprintf(stderr, "Status: %s\n", word);
-		return;
-	}
-
-	if (fstat(fileno(word_file), &stat))
-		err(1, "fstat");
-	if ((where = ftell(word_file)) == -1)
-		err(1, "ftell");
-
-	part_file = where * 100 / (stat.st_size + 1);
-
 	gettimeofday(&tv, NULL);
 	timersub(&tv, &last_tv, &rtv); 
+	count = db_cracks();
 	if (rtv.tv_sec)
-		rate = (float)count/rtv.tv_sec;
+		rate = (float)(count - last_count)/rtv.tv_sec;
 	last_tv = tv;
-	total_count += count;
-	count = 0;
+	last_count = count;
+
+	return (rate);
+}
+
+void
+status_print(char *word)
+{
+	float part_file;
+
+	part_file = (float)wordpos.word * 100 / (words->nwords + 1);
 
 	fprintf(stderr, "Status: % 7.3f%%, % 8.1f c/s: %s\n",
 		(float)(rule_number * 100 + part_file) / rule_count,
-		rate,
+		status_rate(),
 		word);
 }
 
+/*
+ * Words before the resume point have been cracked against all images,
+ * so that an aborted key space search can continue from there.
+ */
+
+void
+status_print_keyspace(u_int64_t key)
+{
+	u_int64_t resume;
+	u_long pending;
+
+	pending = db_pending();
+	resume = key - key_start > pending ? key - pending : key_start;
+
+	fprintf(stderr, "Status: % 7.3f%%, % 8.1f c/s: "
+	    "key %010llx, resume with -k %010llx-%010llx\n",
+	    (double)(key - key_start) * 100 / (key_end - key_start + 1),
+	    status_rate(),
+	    (unsigned long long)key, (unsigned long long)resume,
+	    (unsigned long long)key_end);
+}
+
+void
+status_print_mask(u_int64_t n)
+{
+	fprintf(stderr, "Status: % 7.3f%%, % 8.1f c/s: %s\n",
+	    (double)n * 100 / mask->count, status_rate(), mask->word);
+}
+
 void
 usage(void)
 {
 	fprintf(stderr,
-		"Usage: %s [-V] [-r <rules>] [-f <wordlist>] [-t <schemes>] file.jpg ...\n",
-		progname);
+		"Usage: %s [-V] [-j <threads>] [-r <rules>] [-f <wordlist>] [-t <schemes>]\n"
+		"\t[-u <megabytes>[:<fprate>]] [-k <start>[-<end>]] [-m <megabytes>]\n"
+		"\t[-a <mask>] [-i <min>-<max>[:<charset>]] [-S <shard>/<shards>]\n"
+		"\t[-R <checkpoint>] file.jpg ...\n"
+		"       %s -c [-q] [-j <processes>] [-p <pack>] [-t <schemes>] "
+		"file.jpg ...\n"
+		"       %s -M file ...\n",
+		progname, progname, progname);
 }
 
 void
@@ -133,21 +240,359 @@ sig_handle_inter(int sig)
 	signal(SIGINT, SIG_DFL);
 }
 
+void
+sig_handle_term(int sig)
+{
+	terminated = 1;
+}
+
+/*
+ * With several threads, rule expansion runs in producer threads.  They
+ * take batches of wordlist lines from the line ring and fill word
+ * batches for the cracking threads, so that cheap rules are applied
+ * while the crackers are busy with key setup.
+ */
+
+void *
+rules_producer(void *arg)
+{
+	char buffer[3][RULE_WORD_SIZE * 2];
+	char last[RULE_WORD_SIZE];
+	char rule[RULE_BUFFER_SIZE];
+	struct rules_prog prog;
+	struct linebatch *lines;
+	struct dbbatch *batch;
+	char *word;
+	int i, valid = 0;
+
+	rule[0] = '\0';
+	for (;;) {
+		lines = ring_get_wait(linering);
+
+		/* Compile only when the rule changes */
+		if (strcmp(lines->rule, rule)) {
+			strlcpy(rule, lines->rule, sizeof(rule));
+			valid = rules_compile(&prog, rule, -1) == 0;
+		}
+
+		batch = db_batch_get();
+		last[0] = '\0';
+		for (i = 0; valid && i < lines->nlines && !db_done(); i++) {
+			word = rules_execute(lines->lines[i], &prog, -1,
+			    buffer);
+			if (word == NULL || !strcmp(word, last))
+				continue;
+			if (dedup != NULL && dedup_seen(dedup, word))
+				continue;
+
+			strlcpy(last, word, sizeof(last));
+
+			if (db_batch_add(batch, word)) {
+				db_batch_crack(batch);
+				batch = db_batch_get();
+			}
+		}
+		db_batch_crack(batch);
+
+		ring_put(linefreering, lines);
+		__atomic_add_fetch(&lines_done, 1, __ATOMIC_RELEASE);
+	}
+
+	return (NULL);
+}
+
+void
+rules_producer_start(void)
+{
+	struct linebatch *lines;
+	pthread_t tid;
+	sigset_t set, oset;
+	int i, nproducers, nbatches;
+
+	/* Rule expansion is cheap compared to cracking */
+	nproducers = 1 + nthreads / 8;
+	nbatches = 4 * nproducers;
+
+	linering = ring_new(nbatches);
+	linefreering = ring_new(nbatches);
+	for (i = 0; i < nbatches; i++) {
+		if ((lines = malloc(sizeof(struct linebatch))) == NULL)
+			err(1, "malloc");
+		ring_put(linefreering, lines);
+	}
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	for (i = 0; i < nproducers; i++)
+		if (pthread_create(&tid, NULL, rules_producer, NULL) != 0)
+			errx(1, "%s: pthread_create failed", __func__);
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+}
+
+void
+rules_submit(void)
+{
+	if (curlines == NULL)
+		return;
+
+	__atomic_add_fetch(&lines_submitted, 1, __ATOMIC_RELEASE);
+	ring_put(linering, curlines);
+	curlines = NULL;
+}
+
+void
+rules_queue(char *line, char *rule)
+{
+	if (linering == NULL)
+		rules_producer_start();
+
+	if (curlines == NULL) {
+		curlines = ring_get_wait(linefreering);
+		curlines->nlines = 0;
+		strlcpy(curlines->rule, rule, sizeof(curlines->rule));
+	}
+
+	strlcpy(curlines->lines[curlines->nlines++], line, RULE_WORD_SIZE);
+	if (curlines->nlines == LINE_BATCH)
+		rules_submit();
+}
+
+/* Waits until the producers have queued all their words */
+
+void
+rules_drain(void)
+{
+	int tries = 0;
+
+	rules_submit();
+
+	while (__atomic_load_n(&lines_done, __ATOMIC_ACQUIRE) !=
+	    __atomic_load_n(&lines_submitted, __ATOMIC_ACQUIRE))
+		ring_backoff(&tries);
+}
+
+int
+strpcmp(const void *a, const void *b)
+{
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+void
+done_add(char *filename)
+{
+	if (ndonefiles >= donesize) {
+		donesize = donesize ? 2 * donesize : 1024;
+		donefiles = realloc(donefiles, donesize * sizeof(char *));
+		if (donefiles == NULL)
+			err(1, "realloc");
+	}
+	if ((donefiles[ndonefiles++] = strdup(filename)) == NULL)
+		err(1, "strdup");
+}
+
+/* The images of an attack are done when it finishes */
+
+void
+done_image(char *filename, int found, void *arg)
+{
+	done_add(filename);
+}
+
+void
+checkpoint_image(char *filename, int found, void *arg)
+{
+	fprintf(arg, "%s %s\n", found ? "done" : "loaded", filename);
+}
+
+/*
+ * Saves the position of the attack, the next word or key to try.  The
+ * words that are still being cracked are waited for first, so that
+ * everything before the position has been tried.  The checkpoint is
+ * replaced at once by renaming the new one.
+ */
+
+void
+checkpoint_write(u_int64_t pos)
+{
+	char tmp[PATH_MAX];
+	FILE *fp;
+	int i, res;
+
+	if (linering != NULL)
+		rules_drain();
+	db_drain();
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", checkpoint);
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		warn("%s", tmp);
+		return;
+	}
+
+	fprintf(fp, "stegbreak checkpoint\n");
+	if (keyspace)
+		fprintf(fp, "key %llx\n", (unsigned long long)pos);
+	else if (mask != NULL)
+		fprintf(fp, "mask %llu\ncandidate %llu\n",
+		    (unsigned long long)mask->count,
+		    (unsigned long long)pos);
+	else
+		fprintf(fp, "wordlist %lu\nrule %d\nword %llu\n",
+		    (u_long)words->nwords, rule_number,
+		    (unsigned long long)pos);
+	for (i = 0; i < ndone; i++)
+		fprintf(fp, "done %s\n", donefiles[i]);
+	db_images(checkpoint_image, fp);
+
+	res = fflush(fp) == EOF || fsync(fileno(fp)) == -1;
+	if (fclose(fp) == EOF)
+		res = 1;
+	if (res || rename(tmp, checkpoint) == -1)
+		warn("%s", checkpoint);
+
+	next_checkpoint = time(NULL) + CHECKPOINT_INTERVAL;
+}
+
+/*
+ * Called before the candidate at pos is tried.  Checkpoints are
+ * written when forced, from time to time, and before terminating.
+ */
+
+void
+checkpoint_poll(u_int64_t pos, int force)
+{
+	static u_int count;
+
+	if (checkpoint == NULL)
+		return;
+	if (!force && !terminated &&
+	    (++count % CHECKPOINT_LINES || time(NULL) < next_checkpoint))
+		return;
+
+	checkpoint_write(pos);
+	if (terminated) {
+		fprintf(stderr, "Terminated, resume with -R %s\n",
+		    checkpoint);
+		exit(1);
+	}
+}
+
+void
+checkpoint_start(void)
+{
+	next_checkpoint = time(NULL) + CHECKPOINT_INTERVAL;
+}
+
+/* Returns 0 if there is no checkpoint to resume from */
+
+int
+checkpoint_read(char *name)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t linesize = 0;
+	ssize_t len;
+	unsigned long long v;
+	int haskey = 0, hasword = 0, hasmask = 0, size = 0;
+
+	if ((fp = fopen(name, "r")) == NULL) {
+		if (errno == ENOENT)
+			return (0);
+		err(1, "%s", name);
+	}
+
+	if (getline(&line, &linesize, fp) == -1 ||
+	    strcmp(line, "stegbreak checkpoint\n"))
+		errx(1, "%s: not a checkpoint", name);
+
+	while ((len = getline(&line, &linesize, fp)) != -1) {
+		if (len && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		if (!strncmp(line, "done ", 5)) {
+			done_add(line + 5);
+		} else if (!strncmp(line, "loaded ", 7)) {
+			if (nresume_loaded >= size) {
+				size = size ? 2 * size : 1024;
+				resume_loaded = realloc(resume_loaded,
+				    size * sizeof(char *));
+				if (resume_loaded == NULL)
+					err(1, "realloc");
+			}
+			resume_loaded[nresume_loaded] = strdup(line + 7);
+			if (resume_loaded[nresume_loaded++] == NULL)
+				err(1, "strdup");
+		} else if (sscanf(line, "key %llx", &v) == 1) {
+			resume_key = v;
+			haskey = 1;
+		} else if (sscanf(line, "mask %llu", &v) == 1) {
+			resume_ncandidates = v;
+			hasmask = 1;
+		} else if (sscanf(line, "candidate %llu", &v) == 1) {
+			resume_candidate = v;
+		} else if (sscanf(line, "wordlist %llu", &v) == 1) {
+			resume_nwords = v;
+			hasword = 1;
+		} else if (sscanf(line, "rule %llu", &v) == 1) {
+			resume_rule = v;
+		} else if (sscanf(line, "word %llu", &v) == 1) {
+			resume_word = v;
+		} else
+			errx(1, "%s: bad line: %s", name, line);
+	}
+	free(line);
+	fclose(fp);
+
+	if (keyspace ? !haskey : mask != NULL ? !hasmask : !hasword)
+		errx(1, "%s: checkpoint of a different attack", name);
+	if (mask != NULL && resume_ncandidates != mask->count)
+		errx(1, "%s: the mask has changed", name);
+
+	ndone = nresume_done = ndonefiles;
+	if (ndone)
+		qsort(donefiles, ndone, sizeof(char *), strpcmp);
+	if (nresume_loaded)
+		qsort(resume_loaded, nresume_loaded, sizeof(char *), strpcmp);
+
+	resume = nresume_loaded ? RESUME_LOADED : RESUME_REST;
+
+	return (1);
+}
+
+/* Returns 1 if the image does not belong to this part of a resumed run */
+
+int
+resume_skip(char *filename)
+{
+	int loaded;
+
+	if (resume == RESUME_NONE)
+		return (0);
+
+	loaded = nresume_loaded && bsearch(&filename, resume_loaded,
+	    nresume_loaded, sizeof(char *), strpcmp) != NULL;
+	if (resume == RESUME_LOADED)
+		return (!loaded);
+
+	return (loaded || (nresume_done && bsearch(&filename, donefiles,
+	    nresume_done, sizeof(char *), strpcmp) != NULL));
+}
+
 char *
 do_wordlist_crack(char *name)
 {
 	char line[LINE_BUFFER_SIZE];
+	char buffer[3][RULE_WORD_SIZE * 2];
 	struct rpp_context ctx;
+	struct rules_prog prog;
 	int length;
 	char *rule, *word = NULL;
 	char last[RULE_WORD_SIZE];
 	int rules = 1;
+	size_t start = 0;
 
-	if (name) {
-		if (!(word_file = fopen(name, "r")))
-			err(1, "fopen: %s", name);
-	} else
-		word_file = stdin;
+	/* Mapped and indexed once, each rule makes a pass over it */
+	if (words == NULL)
+		words = wordlist_open(name);
 
 	length = 16;
 
@@ -158,34 +603,52 @@ do_wordlist_crack(char *name)
 	}
 
 	rules_init(length);
+
+	/* New images have to see every word again */
+	if (dedup != NULL)
+		dedup_clear(dedup);
 	rule_count = rules_count(&ctx, -1);
 
-	line_number = rule_number = 0;
+	rule_number = 0;
 
 	rule = rpp_next(&ctx);
 
+	/* The images of a checkpoint have seen the words before it */
+	if (resume == RESUME_LOADED) {
+		if (resume_nwords != words->nwords)
+			errx(1, "%s: the wordlist has changed", checkpoint);
+		while (rule != NULL && rule_number < resume_rule) {
+			rule = rpp_next(&ctx);
+			rule_number++;
+		}
+		start = resume_word;
+	}
+
 	memset(last, ' ', length + 1);
 	last[length + 2] = 0;
 
 	alarmed = signaled = 0;
 	signal(SIGALRM, sig_handle_timer);
 	signal(SIGINT, sig_handle_inter);
+	checkpoint_start();
 
-	total_count += count;
-	count = 0;
+	last_count = db_cracks();
 	gettimeofday(&last_tv, NULL);
 
 	if (rule)
 		do {
-			if ((rule = rules_reject(rule, NULL)))
-				while (fgetl(line, sizeof(line), word_file)) {
-					line_number++;
-
+			if (rules_compile(&prog, rule, -1) == 0)
+				for (wordlist_seek(words, &wordpos, start);
+				     wordlist_next(words, &wordpos, line,
+					 sizeof(line)); ) {
 					if (signaled) {
 						alarm(1);
 						signaled = 0;
 						status_print(last);
+						checkpoint_poll(wordpos.word - 1,
+						    1);
 					}
+					checkpoint_poll(wordpos.word - 1, 0);
 					if (alarmed) {
 						signal(SIGALRM,
 						       sig_handle_timer);
@@ -194,16 +657,31 @@ do_wordlist_crack(char *name)
 						alarmed = 0;
 					}
 
-					if (line[0] == '#')
-						if (!strncmp(line, "#!comment", 9))
-							continue;
+					/* The line belongs to another shard */
+					if ((wordpos.word - 1 + rule_number) %
+					    nshards != shard)
+						continue;
 
-					word = rules_apply(line, rule, -1);
+					if (nthreads > 1) {
+						rules_queue(line, rule);
+						strlcpy(last, line, sizeof(last));
+						if (db_done()) {
+							rules = 0;
+							break;
+						}
+						continue;
+					}
+
+					word = rules_execute(line, &prog, -1,
+					    buffer);
 					if (word == NULL)
 						continue;
 
 					if (!strcmp(word, last))
 						continue;
+					if (dedup != NULL &&
+					    dedup_seen(dedup, word))
+						continue;
 
 					strcpy(last, word);
 			
@@ -213,63 +691,153 @@ do_wordlist_crack(char *name)
 					}
 				}
 
+			/* The next rule overwrites the current one */
+			rules_submit();
+			start = 0;
+
 			if (rules) {
 				if (!(rule = rpp_next(&ctx))) break;
 				rule_number++;
-
-				line_number = 0;
-				if (fseek(word_file, 0, SEEK_SET))
-					err(1, "fseek");
 			}
 		} while (rules);
 
-	if (ferror(word_file))
-		err(1, "fgets");
-
-	if (name) {
-		if (fclose(word_file))
-			err(1, "fclose");
-		word_file = NULL;
-	}
-
 	alarm(0);
 	signal(SIGALRM, SIG_DFL);
 	signal(SIGINT, SIG_DFL);
 
+	if (linering != NULL)
+		rules_drain();
 	db_flush();
 
 	return (!rules ? word : NULL);
 }
 
 /*
- * Converts a JPEG image into a short file that can be used
- * for the dictionary attack instead of the image.
+ * jsteg uses only a 40-bit fold of the password as key.  Instead of
+ * words, all keys in the range are tried, each as a word that folds
+ * to it.
  */
 
-int
-doconvert(char *filename, char *extension, void *obj,
-    int (*obj_write)(char *, void *), void (*obj_destroy)(void *))
+void
+do_keyspace_crack(void)
 {
-	char name[1024], *p;
+	char word[2 * ARC4_FOLDLEN + 1];
+	u_int64_t key;
 
-	strlcpy(name, filename, sizeof(name));
-	p = strrchr(name, '.');
-	if (p != NULL) {
-		*p = '\0';
-		strlcat(name, extension, sizeof(name));
+	alarmed = signaled = 0;
+	signal(SIGALRM, sig_handle_timer);
+	signal(SIGINT, sig_handle_inter);
+	checkpoint_start();
+
+	last_count = db_cracks();
+	gettimeofday(&last_tv, NULL);
+
+	for (key = resume == RESUME_LOADED ? resume_key : key_start; ;
+	     key++) {
+		if (signaled) {
+			alarm(1);
+			signaled = 0;
+			status_print_keyspace(key);
+			checkpoint_poll(key, 1);
+		}
+		checkpoint_poll(key, 0);
+		if (alarmed) {
+			signal(SIGALRM, sig_handle_timer);
+			signal(SIGINT, sig_handle_inter);
+			alarmed = 0;
+		}
+
+		if (key % nshards != shard) {
+			if (key == key_end)
+				break;
+			continue;
+		}
+
+		break_jsteg_keyword(key, word);
+		if (db_crack(word) == 1 || key == key_end)
+			break;
 	}
 
-	if (p == NULL || obj_write(name, obj) == -1) {
-		fprintf(stderr, "%s: can not convert\n", filename);
-		return (-1);
+	alarm(0);
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+
+	db_flush();
+}
+
+/*
+ * Candidates from a mask or incremental enumeration go straight to
+ * the database, without rules or checks against the previous word.
+ */
+
+void
+do_mask_crack(void)
+{
+	u_int64_t n;
+	int i;
+
+	alarmed = signaled = 0;
+	signal(SIGALRM, sig_handle_timer);
+	signal(SIGINT, sig_handle_inter);
+	checkpoint_start();
+
+	last_count = db_cracks();
+	gettimeofday(&last_tv, NULL);
+
+	/* The first candidate of this shard */
+	n = resume == RESUME_LOADED ? resume_candidate : 0;
+	while (n % nshards != shard)
+		n++;
+
+	if (n < mask->count) {
+		mask_seek(mask, n);
+		for (;;) {
+			if (signaled) {
+				alarm(1);
+				signaled = 0;
+				status_print_mask(n);
+				checkpoint_poll(n, 1);
+			}
+			checkpoint_poll(n, 0);
+			if (alarmed) {
+				signal(SIGALRM, sig_handle_timer);
+				signal(SIGINT, sig_handle_inter);
+				alarmed = 0;
+			}
+
+			if (db_crack(mask->word) == 1)
+				break;
+
+			for (i = 0; i < nshards; i++)
+				if (!mask_next(mask))
+					break;
+			if (i < nshards)
+				break;
+			n += nshards;
+		}
 	}
 
-	if (!quiet)
-		fprintf(stderr, "%s: converted to %s\n", filename, extension);
+	alarm(0);
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+
+	db_flush();
+}
 
-	obj_destroy(obj);
+void
+do_crack(void)
+{
+	if (checkpoint != NULL)
+		db_images(done_image, NULL);
+
+	if (keyspace)
+		do_keyspace_crack();
+	else if (mask != NULL)
+		do_mask_crack();
+	else
+		do_wordlist_crack(wordlist);
 
-	return (0);
+	ndone = ndonefiles;
 }
 
 void *
@@ -348,41 +916,184 @@ jsteg_read_jpg(char *filename)
 	return (obj);
 }
 
+/*
+ * obj_pack converts an object into the bytes that are stored for it
+ * and returns their number, obj_unpack makes an object of them again.
+ */
 struct handler {
-	int type;
+	struct dbtype dbt;
 	char *extension;
-	int (*obj_crack)(char *, char *, void *);
-	int (*obj_compare)(void *, void *);
-	void (*obj_destroy)(void *);
-	int (*obj_write)(char *, void *);
+	size_t (*obj_pack)(void *);
+	void *(*obj_unpack)(char *, u_char *, size_t);
 	void *(*obj_read)(char *);
 	void *(*obj_read_jpg)(char *);
 };
 
 struct handler handlers[] = {
 	{
-		FLAG_DOJPHIDE, ".jph",
-		crack_jphide,
-		break_jphide_compare, break_jphide_destroy,
-		break_jphide_write, break_jphide_read,
+		{
+			FLAG_DOJPHIDE,
+			crack_jphide, crack_jphide_report,
+			break_jphide_compare, break_jphide_destroy,
+			break_jphide_state_new, break_jphide_state_free,
+			NULL, crack_jphide_group, break_jphide_size
+		},
+		".jph",
+		break_jphide_pack, break_jphide_unpack, break_jphide_read,
 		jphide_read_jpg
 	},
 	{
-		FLAG_DOOUTGUESS, ".og",
-		crack_outguess,
-		NULL, break_outguess_destroy,
-		break_outguess_write, break_outguess_read,
+		{
+			FLAG_DOOUTGUESS,
+			crack_outguess, crack_outguess_report,
+			NULL, break_outguess_destroy,
+			break_outguess_state_new, break_outguess_state_free,
+			NULL, crack_outguess_group, break_outguess_size
+		},
+		".og",
+		break_outguess_pack, break_outguess_unpack, break_outguess_read,
 		outguess_read_jpg
 	},
 	{
-		FLAG_DOJSTEG, ".jsg",
-		crack_jsteg,
-		NULL, break_jsteg_destroy,
-		break_jsteg_write, break_jsteg_read,
+		{
+			FLAG_DOJSTEG,
+			crack_jsteg, crack_jsteg_report,
+			break_jsteg_compare, break_jsteg_destroy,
+			break_jsteg_state_new, break_jsteg_state_free,
+			break_jsteg_keyclass, crack_jsteg_group,
+			break_jsteg_size
+		},
+		".jsg",
+		break_jsteg_pack, break_jsteg_unpack, break_jsteg_read,
 		jsteg_read_jpg
 	},
+	{ { 0 }, NULL }
 };
 
+struct handler *
+handler_find(int type)
+{
+	struct handler *handle;
+
+	for (handle = &handlers[0]; handle->extension; handle++)
+		if (handle->dbt.type == type)
+			return (handle);
+
+	return (NULL);
+}
+
+/*
+ * Writes a converted image into a short file that can be used for the
+ * dictionary attack instead of the image, or adds it to the pack given
+ * with -p.
+ */
+
+int
+convert_write(char *filename, struct handler *handle, u_char *buf,
+    size_t len)
+{
+	char name[1024], *p;
+	int fd;
+
+	if (pack != NULL)
+		pack_add(pack, filename, handle->dbt.type, buf, len);
+	else {
+		strlcpy(name, filename, sizeof(name));
+		if ((p = strrchr(name, '.')) == NULL)
+			goto fail;
+		*p = '\0';
+		strlcat(name, handle->extension, sizeof(name));
+
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (fd == -1)
+			goto fail;
+		if (write(fd, buf, len) != len) {
+			close(fd);
+			goto fail;
+		}
+		close(fd);
+	}
+
+	if (!quiet)
+		fprintf(stderr, "%s: converted to %s\n", filename,
+		    handle->extension);
+
+	return (0);
+
+ fail:
+	fprintf(stderr, "%s: can not convert\n", filename);
+	return (-1);
+}
+
+/* A worker hands what it converted to the parent */
+
+void
+worker_send(int type, char *filename, u_char *buf, size_t len)
+{
+	u_char msg[sizeof(struct workrec) + PATH_MAX + CONVERT_MAXLEN];
+	struct workrec rec;
+	size_t off, n;
+	ssize_t res;
+
+	rec.type = type;
+	rec.namelen = strlen(filename);
+	rec.len = len;
+	if (rec.namelen >= PATH_MAX || len > CONVERT_MAXLEN)
+		errx(1, "%s: can not convert", filename);
+
+	memcpy(msg, &rec, sizeof(rec));
+	off = sizeof(rec);
+	memcpy(msg + off, filename, rec.namelen);
+	off += rec.namelen;
+	if (len)
+		memcpy(msg + off, buf, len);
+	off += len;
+
+	for (n = 0; n < off; n += res) {
+		res = write(worker_fd, msg + n, off - n);
+		if (res == -1 && errno == EINTR)
+			res = 0;
+		else if (res == -1)
+			err(1, "write");
+	}
+}
+
+/* Returns 0 if the worker is done and -1 if it stopped in between */
+
+int
+worker_read(int fd, void *buf, size_t len)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < len; off += n) {
+		n = read(fd, (u_char *)buf + off, len - off);
+		if (n == -1 && errno == EINTR)
+			n = 0;
+		else if (n <= 0)
+			return (off == 0 && n == 0 ? 0 : -1);
+	}
+
+	return (1);
+}
+
+int
+doconvert(char *filename, struct handler *handle, void *obj)
+{
+	size_t len;
+	int res = 0;
+
+	len = handle->obj_pack(obj);
+	if (worker_fd != -1)
+		worker_send(handle->dbt.type, filename, obj, len);
+	else
+		res = convert_write(filename, handle, obj, len);
+
+	handle->dbt.free(obj);
+
+	return (res);
+}
+
 int
 doinsert(char *filename, int scans)
 {
@@ -392,7 +1103,8 @@ doinsert(char *filename, int scans)
 
 	if (!file_hasextension(filename, ".jpg") &&
 	    !file_hasextension(filename, ".jpeg")) {
-		if (convert)
+		/* Converted files can only be put into a pack */
+		if (convert && packname == NULL)
 			return (-1);
 
 		for (handle = &handlers[0]; handle->extension; handle++)
@@ -400,32 +1112,29 @@ doinsert(char *filename, int scans)
 				break;
 		if (handle->extension == NULL)
 			return (-1);
+		if (keyspace && handle->dbt.type != FLAG_DOJSTEG)
+			return (-1);
 
 		if ((obj = handle->obj_read(filename)) == NULL)
 			return (-1);
 
-		db_insert(filename, handle->type, obj,
-		    handle->obj_crack, handle->obj_compare,
-		    handle->obj_destroy);
+		if (convert || worker_fd != -1)
+			doconvert(filename, handle, obj);
+		else
+			db_insert(filename, &handle->dbt, obj);
 	} else {
 		res = -1;
 
 		for (handle = &handlers[0]; handle->extension; handle++) {
-			if (scans & handle->type) {
+			if (scans & handle->dbt.type) {
 				obj = handle->obj_read_jpg(filename);
 				if (obj == NULL)
 					continue;
 
-				if (convert)
-					doconvert(filename, handle->extension,
-					    obj,
-					    handle->obj_write,
-					    handle->obj_destroy);
+				if (convert || worker_fd != -1)
+					doconvert(filename, handle, obj);
 				else
-					db_insert(filename, handle->type, obj,
-					    handle->obj_crack,
-					    handle->obj_compare,
-					    handle->obj_destroy);
+					db_insert(filename, &handle->dbt, obj);
 
 				res = 0;
 			}
@@ -435,35 +1144,392 @@ doinsert(char *filename, int scans)
 	return (res);
 }
 
-#define MAX_FILES 1024
+/*
+ * All images are loaded before the words are cracked against them.
+ * Only when their memory reaches the limit given with -m are the
+ * words cracked against the images that have been loaded so far.
+ */
+
+void
+process_count(int *pi, int *pn)
+{
+	(*pi)++;
+	(*pn)++;
+
+	if (!convert && worker_fd == -1 && db_memory() >= maxmemory) {
+		fprintf(stderr, "Loaded %i files...\n", *pi);
+		do_crack();
+		*pi = 0;
+	}
+}
+
+struct packitem {
+	char *filename;
+	int entry;
+};
+
+int
+packitem_compare(const void *a, const void *b)
+{
+	const struct packitem *pa = a, *pb = b;
+	int res;
+
+	if ((res = strcmp(pa->filename, pb->filename)) != 0)
+		return (res);
+	return (pa->entry - pb->entry);
+}
+
+/*
+ * Loads the objects in a pack as if they had been separate files.  An
+ * image may have an object for every scheme, so the entries are taken
+ * by name and every image is counted once, after its last object.
+ */
+
+void
+process_pack(char *name, int *pi, int *pn)
+{
+	struct handler *handle;
+	struct packitem *items;
+	struct pack *pk;
+	char *filename;
+	u_char *buf;
+	size_t len;
+	void *obj;
+	int i, n, type, loaded;
+
+	if ((pk = pack_open(name)) == NULL)
+		return;
+
+	if ((items = calloc(pk->count + 1, sizeof(struct packitem))) == NULL)
+		err(1, "calloc");
+	for (i = n = 0; i < pk->count; i++) {
+		if (pack_entry(pk, i, &type, &filename, &buf, &len) == -1) {
+			warnx("%s: bad entry %d", name, i);
+			continue;
+		}
+		items[n].filename = filename;
+		items[n].entry = i;
+		n++;
+	}
+	qsort(items, n, sizeof(struct packitem), packitem_compare);
+
+	loaded = 0;
+	for (i = 0; i < n; i++) {
+		pack_entry(pk, items[i].entry, &type, &filename, &buf, &len);
+		if (resume_skip(filename))
+			goto next;
+		if ((handle = handler_find(type)) == NULL)
+			goto next;
+		if (keyspace && type != FLAG_DOJSTEG)
+			goto next;
+
+		if ((obj = handle->obj_unpack(filename, buf, len)) == NULL) {
+			warnx("%s: %s: bad object", name, filename);
+			goto next;
+		}
+
+		db_insert(filename, &handle->dbt, obj);
+		loaded = 1;
+
+	next:
+		if (loaded && (i + 1 == n ||
+			strcmp(filename, items[i + 1].filename))) {
+			process_count(pi, pn);
+			loaded = 0;
+		}
+	}
+
+	free(items);
+	pack_close(pk);
+}
 
 void
 process_loop(char *name, int scans, int *pi, int *pn)
 {
-	int i, n;
+	if (!convert && file_hasextension(name, PACK_EXTENSION)) {
+		process_pack(name, pi, pn);
+		return;
+	}
 
-	i = *pi;
-	n = *pn;
+	if (resume_skip(name))
+		return;
 
 	if (doinsert(name, scans) != -1) {
-		i++;
-		n++;
+		if (worker_fd != -1)
+			worker_send(0, name, NULL, 0);
+		process_count(pi, pn);
 	}
+}
 
-	if (!convert && i >= MAX_FILES) {
-		fprintf(stderr, "Loaded %i files...\n",
-		    i);
-		do_wordlist_crack(wordlist);
-		i = 0;
+/*
+ * Decodes the images with several processes, as the JPEG decoder
+ * keeps global state.  The parent deals the files out one at a time,
+ * in the order of the walk, to whichever worker is free.  The workers
+ * send the objects back to the parent, which loads or writes them.  A
+ * worker stops while its pipe is full, so no more than that is
+ * waiting.  Packs are loaded by the parent afterwards.
+ */
+
+void
+process_parallel(struct walk *w, int scans, int *pi, int *pn)
+{
+	struct pollfd pfd[DB_MAXTHREADS + 1];
+	pid_t pids[DB_MAXTHREADS];
+	struct handler *handle;
+	struct workrec rec;
+	char name[PATH_MAX];
+	u_char buf[CONVERT_MAXLEN];
+	void (*sigpipe)(int);
+	void *obj;
+	int fds[2], queue[2], i, j, k, n, next, left, status;
+
+	/* The parent must not block on the queue, but the workers do */
+	if (pipe(queue) == -1)
+		err(1, "pipe");
+	if (fcntl(queue[1], F_SETFL, O_NONBLOCK) == -1)
+		err(1, "fcntl");
+
+	for (i = 0; i < nthreads; i++) {
+		if (pipe(fds) == -1)
+			err(1, "pipe");
+		if ((pids[i] = fork()) == -1)
+			err(1, "fork");
+		if (pids[i] == 0) {
+			for (j = 0; j < i; j++)
+				close(pfd[j].fd);
+			close(fds[0]);
+			close(queue[1]);
+			worker_fd = fds[1];
+
+			/* The parent reports on what it loads */
+			signal(SIGINT, SIG_IGN);
+			signal(SIGTERM, SIG_DFL);
+			if (!convert && freopen("/dev/null", "w", stdout) == NULL)
+				err(1, "/dev/null");
+
+			j = n = 0;
+			while ((k = walk_take(queue[0])) != -1)
+				process_loop(w->names[k], scans, &j, &n);
+			exit(0);
+		}
+		close(fds[1]);
+		pfd[i].fd = fds[0];
+		pfd[i].events = POLLIN;
+	}
+	close(queue[0]);
+	pfd[nthreads].fd = queue[1];
+	pfd[nthreads].events = POLLOUT;
+
+	/* Stop dealing if all workers have failed */
+	sigpipe = signal(SIGPIPE, SIG_IGN);
+
+	for (next = 0, left = nthreads; left > 0;) {
+		if (poll(pfd, nthreads + 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "poll");
+		}
+
+		if (pfd[nthreads].fd != -1 && pfd[nthreads].revents) {
+			for (; next < w->nnames; next++) {
+				if (file_hasextension(w->names[next],
+					PACK_EXTENSION))
+					continue;
+				if (write(pfd[nthreads].fd, &next,
+					sizeof(next)) == -1)
+					break;
+			}
+			if (next == w->nnames ||
+			    (errno != EAGAIN && errno != EINTR)) {
+				close(pfd[nthreads].fd);
+				pfd[nthreads].fd = -1;
+			}
+		}
+
+		for (i = 0; i < nthreads; i++) {
+			if (pfd[i].fd == -1 || pfd[i].revents == 0)
+				continue;
+
+			if ((j = worker_read(pfd[i].fd, &rec,
+				 sizeof(rec))) == 0) {
+				/* Negative descriptors are ignored by poll */
+				close(pfd[i].fd);
+				pfd[i].fd = -1;
+				left--;
+				continue;
+			}
+			if (j == -1 || rec.namelen >= sizeof(name) ||
+			    rec.len > sizeof(buf) ||
+			    worker_read(pfd[i].fd, name, rec.namelen) != 1 ||
+			    worker_read(pfd[i].fd, buf, rec.len) != 1)
+				errx(1, "%s: bad data from worker %d",
+				    __func__, i + 1);
+			name[rec.namelen] = '\0';
+
+			if (rec.type == 0) {
+				process_count(pi, pn);
+				continue;
+			}
+			if ((handle = handler_find(rec.type)) == NULL)
+				continue;
+			if (convert)
+				convert_write(name, handle, buf, rec.len);
+			else if ((obj = handle->obj_unpack(name, buf,
+				      rec.len)) != NULL)
+				db_insert(name, &handle->dbt, obj);
+		}
+	}
+
+	if (pfd[nthreads].fd != -1)
+		close(pfd[nthreads].fd);
+	signal(SIGPIPE, sigpipe);
+
+	for (i = 0; i < nthreads; i++) {
+		if (waitpid(pids[i], &status, 0) == -1)
+			err(1, "waitpid");
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			warnx("worker %d failed", i + 1);
 	}
 
-	*pi = i;
-	*pn = n;
+	if (!convert)
+		for (i = 0; i < w->nnames; i++)
+			if (file_hasextension(w->names[i], PACK_EXTENSION))
+				process_pack(w->names[i], pi, pn);
+}
+
+/* Loads the files given as arguments, directories are walked */
+
+void
+process_files(struct walk *w, int scans, int *pi, int *pn)
+{
+	int i;
+
+	if (nthreads > 1 && w->nnames > 1) {
+		process_parallel(w, scans, pi, pn);
+		return;
+	}
+
+	for (i = 0; i < w->nnames; i++)
+		process_loop(w->names[i], scans, pi, pn);
+}
+
+/*
+ * Combines the output of the shards of a search.  An image is shown
+ * with every embedding that any shard found, and as negative only if
+ * none did.  Shards that have not completed are warned about, their
+ * part of the search is missing.
+ */
+
+struct mergeline {
+	char *filename;
+	char *result;
+};
+
+int
+merge_compare(const void *a, const void *b)
+{
+	const struct mergeline *ma = a, *mb = b;
+	int res;
+
+	if ((res = strcmp(ma->filename, mb->filename)) != 0)
+		return (res);
+
+	return (strcmp(ma->result, mb->result));
+}
+
+void
+do_merge(int argc, char **argv)
+{
+	struct mergeline *lines = NULL;
+	FILE *fp;
+	char *line = NULL, *p;
+	size_t linesize = 0;
+	ssize_t len;
+	u_char *complete = NULL;
+	int i, j, n = 0, size = 0, k, m, shards = 0, positive;
+
+	for (; argc; argc--, argv++) {
+		if ((fp = fopen(argv[0], "r")) == NULL)
+			err(1, "fopen: %s", argv[0]);
+
+		while ((len = getline(&line, &linesize, fp)) != -1) {
+			if (len && line[len - 1] == '\n')
+				line[len - 1] = '\0';
+
+			if (sscanf(line, "Shard %d/%d complete", &k, &m) == 2) {
+				if (shards == 0) {
+					shards = m;
+					if ((complete = calloc(m, 1)) == NULL)
+						err(1, "calloc");
+				}
+				if (m != shards || k < 1 || k > m)
+					errx(1, "%s: shard %d/%d does not "
+					    "belong to %d shards", argv[0],
+					    k, m, shards);
+				complete[k - 1] = 1;
+				continue;
+			}
+
+			if ((p = strstr(line, " : ")) == NULL)
+				continue;
+			*p = '\0';
+
+			if (n >= size) {
+				size = size ? 2 * size : 1024;
+				lines = realloc(lines,
+				    size * sizeof(struct mergeline));
+				if (lines == NULL)
+					err(1, "realloc");
+			}
+			lines[n].filename = strdup(line);
+			lines[n].result = strdup(p + 3);
+			if (lines[n].filename == NULL ||
+			    lines[n].result == NULL)
+				err(1, "strdup");
+			n++;
+		}
+		fclose(fp);
+	}
+	free(line);
+
+	qsort(lines, n, sizeof(struct mergeline), merge_compare);
+
+	for (i = 0; i < n; i = j) {
+		positive = 0;
+		for (j = i; j < n &&
+		     !strcmp(lines[i].filename, lines[j].filename); j++) {
+			if (!strcmp(lines[j].result, "negative"))
+				continue;
+			if (j > i && !strcmp(lines[j].result,
+				lines[j - 1].result))
+				continue;
+			fprintf(stdout, "%s : %s\n", lines[j].filename,
+			    lines[j].result);
+			positive = 1;
+		}
+		if (!positive)
+			fprintf(stdout, "%s : negative\n", lines[i].filename);
+	}
+
+	if (shards == 0)
+		warnx("no shard has completed");
+	for (k = 0; k < shards; k++)
+		if (!complete[k])
+			warnx("shard %d/%d has not completed", k + 1, shards);
+
+	for (i = 0; i < n; i++) {
+		free(lines[i].filename);
+		free(lines[i].result);
+	}
+	free(lines);
+	free(complete);
 }
 
 int
 main(int argc, char *argv[])
 {
+	struct handler *handle;
+	struct walk *files;
 	int i, n, scans;
 	extern char *optarg;
 	extern int optind;
@@ -475,7 +1541,7 @@ main(int argc, char *argv[])
 	scans = FLAG_DOJPHIDE;
 
 	/* read command line arguments */
-	while ((ch = getopt(argc, argv, "cqs:f:r:Vd:t:")) != -1)
+	while ((ch = getopt(argc, argv, "cqs:f:r:Vd:t:j:u:k:m:S:MR:a:i:p:")) != -1)
 		switch((char)ch) {
 		case 'c':
 			convert = 1;
@@ -489,6 +1555,93 @@ main(int argc, char *argv[])
 		case 'f':
 			wordlist = optarg;
 			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1 || nthreads > DB_MAXTHREADS)
+				errx(1, "number of threads must be 1 - %d",
+				    DB_MAXTHREADS);
+			break;
+		case 'u': {
+			char *p;
+			double fprate = 0;
+			long megs;
+
+			megs = strtol(optarg, &p, 10);
+			if (*p == ':') {
+				fprate = strtod(p + 1, &p);
+				if (fprate <= 0 || fprate >= 1)
+					errx(1, "false positive rate must be "
+					    "between 0 and 1");
+			}
+			if (megs < 1 || *p != '\0')
+				errx(1, "bad duplicate filter size: %s",
+				    optarg);
+			dedup = dedup_new((size_t)megs << 20, fprate);
+			break;
+		}
+		case 'k': {
+			char *p;
+
+			keyspace = 1;
+			key_start = strtoull(optarg, &p, 16);
+			if (*p == '-')
+				key_end = strtoull(p + 1, &p, 16);
+			if (*p != '\0' || key_start > key_end ||
+			    key_end > KEYSPACE_MAX)
+				errx(1, "bad key range: %s", optarg);
+			break;
+		}
+		case 'm': {
+			char *p;
+			long megs;
+
+			megs = strtol(optarg, &p, 10);
+			if (megs < 1 || *p != '\0')
+				errx(1, "bad memory limit: %s", optarg);
+			maxmemory = (size_t)megs << 20;
+			break;
+		}
+		case 'S': {
+			char *p;
+
+			shard = strtol(optarg, &p, 10);
+			if (*p == '/')
+				nshards = strtol(p + 1, &p, 10);
+			if (*p != '\0' || nshards < 1 || shard < 1 ||
+			    shard > nshards)
+				errx(1, "bad shard: %s", optarg);
+			shard--;
+			break;
+		}
+		case 'M':
+			merge = 1;
+			break;
+		case 'R':
+			checkpoint = optarg;
+			break;
+		case 'p':
+			packname = optarg;
+			break;
+		case 'a':
+			if (mask != NULL)
+				errx(1, "only one of -a and -i");
+			mask = mask_new(optarg);
+			break;
+		case 'i': {
+			char *p;
+			int min, max;
+
+			if (mask != NULL)
+				errx(1, "only one of -a and -i");
+			min = max = strtol(optarg, &p, 10);
+			if (*p == '-')
+				max = strtol(p + 1, &p, 10);
+			if (*p != '\0' && *p != ':')
+				errx(1, "bad length: %s", optarg);
+			mask = mask_incremental(*p == ':' ? p + 1 : "?a",
+			    min, max);
+			break;
+		}
 		case 'V':
 			fprintf(stdout, "Stegbreak Version %s\n", VERSION);
 			exit(1);
@@ -518,87 +1671,98 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	/* The key space is that of jsteg */
+	if (keyspace)
+		scans = FLAG_DOJSTEG;
+	if (keyspace && mask != NULL)
+		errx(1, "-k cannot be used with -a or -i");
+	if (packname != NULL && !convert)
+		errx(1, "-p can only be used with -c");
+
 	if (argc < 1) {
 		usage();
 		exit(1);
 	}
 
+	if (merge) {
+		do_merge(argc, argv);
+		exit(0);
+	}
+
+	files = walk_new(NULL);
+	for (i = 0; i < argc; i++)
+		walk_add(files, argv[i]);
+
 	/* Set up magic rules */
 	if (file_init())
 		errx(1, "file magic initializiation failed");
 
         if (!convert) {
-		cfg_init(rules_name);
-		db_init();
+		if (!keyspace && mask == NULL) {
+			cfg_init(rules_name);
+			words = wordlist_open(wordlist);
+		}
+		db_init(nthreads);
+		for (handle = &handlers[0]; handle->extension; handle++)
+			db_register(&handle->dbt);
+
+		if (checkpoint != NULL) {
+			if (checkpoint_read(checkpoint))
+				fprintf(stderr, "Resuming from %s\n",
+				    checkpoint);
+
+			/* Saved at the next candidate */
+			signal(SIGTERM, sig_handle_term);
+		}
 	}
 
 	setvbuf(stdout, NULL, _IOLBF, 0);
 
-	/* Set up counters */
-	total_count = count = 0;
 	starttime = time(NULL);
 	
 	n = i = 0;
-	while (argc) {
-		struct stat sb;
-
-		if (stat(argv[0], &sb) == -1)
-			goto end;
-		if (sb.st_mode & S_IFDIR) {
-			DIR *dir;
-			struct dirent *file;
-			char fullname[PATH_MAX];
-			int off;
-
-			if (strlen(argv[0]) >= sizeof (fullname) - 2) {
-				warnx("%s: directory name too long", argv[0]);
-				goto end;
-			}
-
-			if ((dir = opendir(argv[0])) == NULL) {
-				warn("%s", argv[0]);
-				goto end;
-			}
-
-			strlcpy(fullname, argv[0], sizeof (fullname));
-			off = strlen(fullname);
-			if (fullname[off - 1] != '/') {
-				strlcat(fullname, "/", sizeof(fullname));
-				off++;
-			}
-			
-			while ((file = readdir(dir)) != NULL) {
-				if (!strcmp(file->d_name, ".") ||
-				    !strcmp(file->d_name, ".."))
-					continue;
-
-				strlcpy(fullname + off, file->d_name,
-				    sizeof(fullname) - off);
-				
-				process_loop(fullname, scans, &i, &n);
-			}
-			closedir(dir);
-		} else
-			process_loop(argv[0], scans, &i, &n);
-
-	end:
-		argc--;
-		argv++;
+	if (resume == RESUME_LOADED) {
+		process_files(files, scans, &i, &n);
+		if (i) {
+			fprintf(stderr, "Resuming %i files...\n", i);
+			do_crack();
+			i = 0;
+		}
+		resume = RESUME_REST;
 	}
 
+	if (packname != NULL)
+		pack = pack_create(packname);
+	process_files(files, scans, &i, &n);
+	if (pack != NULL)
+		pack_finish(pack);
+
 	if (!convert && i) {
 		fprintf(stderr, "Loaded %i files...\n", i);
-		do_wordlist_crack(wordlist);
+		do_crack();
 	}
 
 	if (!convert) {
 		time_t now = time(NULL) - starttime;
+		u_int32_t total_count = db_cracks();
 
-		total_count += count;
 		fprintf(stderr, "Processed %d files, found %d embeddings.\n",
-			n, found);
+			n, db_found());
 		fprintf(stderr, "Time: %d seconds: Cracks: %d, % 8.1f c/s\n",
 		    now, total_count, (float)total_count/now);
+		if (dedup != NULL)
+			fprintf(stderr, "Duplicates removed: %llu\n",
+			    (unsigned long long)dedup_removed(dedup));
+
+		/* Nothing is left to resume */
+		if (checkpoint != NULL)
+			unlink(checkpoint);
+
+		/* Tells the merge that this part has been searched */
+		if (nshards > 1)
+			fprintf(stdout, "Shard %d/%d complete: %d files, "
+			    "%d embeddings\n", shard + 1, nshards, n,
+			    db_found());
 	} else
 		fprintf(stderr, "Converted %d files.\n", n);
 
@@ -29,6 +29,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include "config.h"
 
@@ -36,6 +37,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <signal.h>
 #include <err.h>
 #include <string.h>
 #include <math.h>
@@ -47,6 +49,7 @@
 #include "common.h"
 #include "extraction.h"
 #include "discrimination.h"
+#include "walk.h"
 
 #define DBG_PRINTHIST	0x0001
 #define DBG_CHIDIFF	0x0002
@@ -70,6 +73,9 @@
 #define FLAG_CHECKHDRS	0x1000
 #define FLAG_JPHIDESTAT	0x2000
 
+#define MAXPROCS	64
+#define DETECT_BATCH	1024	/* Names from stdin dealt out at once */
+
 float chi2cdf(float chi, int dgf);
 double detect_f5(char *);
 
@@ -80,6 +86,9 @@ float scale = 1;		/* Sensitivity scaling */
 
 static int debug_flags = 0;
 static int quiet = 0;
+static int nprocs = 1;
+static int histonly = 0;
+static char *exts[] = { ".jpg", ".jpeg", NULL };
 static int ispositive = 0;	/* Current images contain stego */
 static char *transformname;	/* Current transform name */
 
@@ -1087,7 +1096,7 @@ usage(void)
 {
 	fprintf(stderr,
 	    "Usage: %s [-nqV] [-s <float>] [-d <num>] [-t <tests>] [-C <num>]\n"
-	    "\t [file.jpg ...]\n",
+	    "\t [-j <processes>] [file.jpg | directory ...]\n",
 		progname);
 }
 
@@ -1397,10 +1406,75 @@ detect(char *filename, int scans)
 	jpg_destroy();
 }
 
+/*
+ * Runs the tests on the files of a walk.  The JPEG decoder keeps
+ * global state, so several processes are used instead of threads.
+ * They are handed the files one at a time in the order of the walk
+ * and print their own results, so these come out in the order in
+ * which the processes finish the files.
+ */
+
+void
+detect_files(struct walk *w, int scans)
+{
+	pid_t pids[MAXPROCS];
+	void (*sigpipe)(int);
+	int fds[2], i, j, n, status;
+
+	/* The statistics are only counted in one process */
+	n = nprocs < w->nnames ? nprocs : w->nnames;
+	if (debug_flags & FLAG_JPHIDESTAT)
+		n = 1;
+
+	if (n <= 1) {
+		for (i = 0; i < w->nnames; i++)
+			if (histonly)
+				dohistogram(w->names[i]);
+			else
+				detect(w->names[i], scans);
+		return;
+	}
+
+	if (pipe(fds) == -1)
+		err(1, "pipe");
+
+	for (j = 0; j < n; j++) {
+		if ((pids[j] = fork()) == -1)
+			err(1, "fork");
+		if (pids[j] != 0)
+			continue;
+
+		close(fds[1]);
+		while ((i = walk_take(fds[0])) != -1)
+			if (histonly)
+				dohistogram(w->names[i]);
+			else
+				detect(w->names[i], scans);
+
+		/* exit would move the offset of stdin, which is shared */
+		fflush(stdout);
+		_exit(0);
+	}
+	close(fds[0]);
+
+	/* Stop dealing if all processes have failed */
+	sigpipe = signal(SIGPIPE, SIG_IGN);
+	for (i = 0; i < w->nnames; i++)
+		if (write(fds[1], &i, sizeof(i)) != sizeof(i))
+			break;
+	close(fds[1]);
+	signal(SIGPIPE, sigpipe);
+
+	for (j = 0; j < n; j++)
+		if (waitpid(pids[j], &status, 0) == -1)
+			err(1, "waitpid");
+}
+
 int
 main(int argc, char *argv[])
 {
-	int i, scans, checkhdr = 0, usecd = 0, histonly = 0;
+	int i, scans, checkhdr = 0, usecd = 0;
+	struct walk *files;
 	struct cd_decision *cdd = NULL;
 	FILE *fin;
 	extern char *optarg;
@@ -1415,7 +1489,7 @@ main(int argc, char *argv[])
 	cd_init();
 
 	/* read command line arguments */
-	while ((ch = getopt(argc, argv, "C:D:c:nhs:Vd:t:q")) != -1)
+	while ((ch = getopt(argc, argv, "C:D:c:nhs:Vd:t:qj:")) != -1)
 		switch((char)ch) {
 		case 'h':
 			histonly = 1;
@@ -1468,6 +1542,12 @@ main(int argc, char *argv[])
 		case 'q':
 			quiet = 1;
 			break;
+		case 'j':
+			nprocs = atoi(optarg);
+			if (nprocs < 1 || nprocs > MAXPROCS)
+				errx(1, "number of processes must be 1 - %d",
+				    MAXPROCS);
+			break;
 		case 's':
 			if ((scale = atof(optarg)) == 0) {
 				usage();
@@ -1560,25 +1640,34 @@ main(int argc, char *argv[])
 
 	setvbuf(stdout, NULL, _IOLBF, 0);
 
+	/* Directories are walked for JPEG images */
+	files = walk_new(exts);
 	if (argc > 0) {
 		while (argc) {
-			if (histonly)
-				dohistogram(argv[0]);
-			else
-				detect(argv[0], scans);
-			
+			walk_add(files, argv[0]);
 			argc--;
 			argv++;
 		}
+		detect_files(files, scans);
 	} else {
 		char line[1024];
 
-		while (fgetl(line, sizeof(line), stdin) != NULL)
-			if (histonly)
-				dohistogram(line);
-			else
-				detect(line, scans);
+		/*
+		 * Unless the names are dealt out, each is done at once.
+		 * Otherwise they are dealt out in batches, so that work
+		 * starts before the last name has been read.
+		 */
+		while (fgetl(line, sizeof(line), stdin) != NULL) {
+			walk_add(files, line);
+			if (nprocs == 1 || files->nnames >= DETECT_BATCH) {
+				detect_files(files, scans);
+				walk_free(files);
+				files = walk_new(exts);
+			}
+		}
+		detect_files(files, scans);
 	}
+	walk_free(files);
 
 	if (debug_flags & FLAG_JPHIDESTAT) {
 		fprintf(stdout, "Positive rejected because of\n"
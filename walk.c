@@ -0,0 +1,241 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include "config.h"
+#include "common.h"
+#include "walk.h"
+
+#ifndef HAVE_STRLCPY
+size_t strlcpy(char *, const char *, size_t);
+#endif
+#ifndef HAVE_STRLCAT
+size_t strlcat(char *, const char *, size_t);
+#endif
+
+#ifndef PATH_MAX
+#define PATH_MAX	1024
+#endif
+
+struct walkent {
+	ino_t ino;
+	int isdir;
+	char *name;
+};
+
+static void walk_dir(struct walk *, char *);
+
+struct walk *
+walk_new(char **exts)
+{
+	struct walk *w;
+
+	if ((w = calloc(1, sizeof(struct walk))) == NULL)
+		err(1, "calloc");
+	w->exts = exts;
+
+	return (w);
+}
+
+static void
+walk_append(struct walk *w, char *name)
+{
+	if (w->nnames >= w->size) {
+		w->size = w->size ? 2 * w->size : 1024;
+		w->names = realloc(w->names, w->size * sizeof(char *));
+		if (w->names == NULL)
+			err(1, "realloc");
+	}
+	if ((w->names[w->nnames++] = strdup(name)) == NULL)
+		err(1, "strdup");
+}
+
+static int
+walk_match(struct walk *w, char *name)
+{
+	char **ext;
+
+	if (w->exts == NULL)
+		return (1);
+	for (ext = w->exts; *ext != NULL; ext++)
+		if (file_hasextension(name, *ext))
+			return (1);
+
+	return (0);
+}
+
+static int
+walk_inocmp(const void *a, const void *b)
+{
+	const struct walkent *wa = a, *wb = b;
+
+	if (wa->ino < wb->ino)
+		return (-1);
+	return (wa->ino > wb->ino);
+}
+
+/*
+ * Adds a file given by the user, which is taken whatever its name.
+ * Names that cannot be looked at are added, too, so that they fail
+ * where they are used.
+ */
+
+void
+walk_add(struct walk *w, char *name)
+{
+	struct stat sb;
+
+	if (stat(name, &sb) != -1 && S_ISDIR(sb.st_mode))
+		walk_dir(w, name);
+	else
+		walk_append(w, name);
+}
+
+/*
+ * Reads all entries of a directory first, so that it is closed again
+ * before descending.  The type of an entry comes with it on most
+ * systems, otherwise it is looked up.  Symbolic links to directories
+ * are not followed.
+ */
+
+static void
+walk_dir(struct walk *w, char *name)
+{
+	DIR *dir;
+	struct dirent *file;
+	struct walkent *ents = NULL;
+	char fullname[PATH_MAX];
+	struct stat sb;
+	int i, n = 0, size = 0, off;
+
+	if (strlen(name) >= sizeof(fullname) - 2) {
+		warnx("%s: directory name too long", name);
+		return;
+	}
+
+	if ((dir = opendir(name)) == NULL) {
+		warn("%s", name);
+		return;
+	}
+
+	strlcpy(fullname, name, sizeof(fullname));
+	off = strlen(fullname);
+	if (fullname[off - 1] != '/') {
+		strlcat(fullname, "/", sizeof(fullname));
+		off++;
+	}
+
+	while ((file = readdir(dir)) != NULL) {
+		if (!strcmp(file->d_name, ".") ||
+		    !strcmp(file->d_name, ".."))
+			continue;
+
+		if (n >= size) {
+			size = size ? 2 * size : 64;
+			ents = realloc(ents, size * sizeof(struct walkent));
+			if (ents == NULL)
+				err(1, "realloc");
+		}
+		ents[n].ino = file->d_ino;
+		ents[n].isdir = -1;
+#ifdef DT_DIR
+		if (file->d_type != DT_UNKNOWN)
+			ents[n].isdir = file->d_type == DT_DIR;
+#endif
+		if ((ents[n].name = strdup(file->d_name)) == NULL)
+			err(1, "strdup");
+		n++;
+	}
+	closedir(dir);
+
+	qsort(ents, n, sizeof(struct walkent), walk_inocmp);
+
+	for (i = 0; i < n; i++) {
+		if (strlcpy(fullname + off, ents[i].name,
+			sizeof(fullname) - off) >= sizeof(fullname) - off) {
+			warnx("%s: name too long", ents[i].name);
+			goto next;
+		}
+
+		if (ents[i].isdir == -1)
+			ents[i].isdir = lstat(fullname, &sb) != -1 &&
+			    S_ISDIR(sb.st_mode);
+
+		if (ents[i].isdir)
+			walk_dir(w, fullname);
+		else if (walk_match(w, fullname))
+			walk_append(w, fullname);
+	next:
+		free(ents[i].name);
+	}
+	free(ents);
+}
+
+void
+walk_free(struct walk *w)
+{
+	int i;
+
+	for (i = 0; i < w->nnames; i++)
+		free(w->names[i]);
+	free(w->names);
+	free(w);
+}
+
+/*
+ * Workers share the read end of a pipe into which the parent writes
+ * the indices of the names, in the order of the walk.  Each worker
+ * takes the next one when it is done with its file, so the files are
+ * still read roughly in disk order and no worker waits while others
+ * have work left.  An int is written to a pipe in one piece, so every
+ * read gets a whole index.  Returns -1 once the pipe is closed.
+ */
+
+int
+walk_take(int fd)
+{
+	ssize_t n;
+	int i;
+
+	do {
+		n = read(fd, &i, sizeof(i));
+	} while (n == -1 && errno == EINTR);
+
+	return (n == sizeof(i) ? i : -1);
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "config.h"
+#include "wordlist.h"
+
+#ifndef MAP_FAILED
+#define MAP_FAILED	((void *)-1)
+#endif
+
+#define COMMENT		"#!comment"
+
+/* Reads data that can not be mapped, like a pipe */
+
+static int
+wordlist_read(struct wordlist *wl, int fd)
+{
+	size_t len = 0, size = 65536;
+	u_char *data = NULL, *tmp;
+	ssize_t n;
+
+	for (;;) {
+		if ((tmp = realloc(data, size)) == NULL) {
+			free(data);
+			return (-1);
+		}
+		data = tmp;
+
+		if ((n = read(fd, data + len, size - len)) == -1) {
+			free(data);
+			return (-1);
+		}
+		if (n == 0)
+			break;
+		len += n;
+		if (len == size)
+			size <<= 1;
+	}
+
+	wl->data = data;
+	wl->size = len;
+	wl->mapped = 0;
+
+	return (0);
+}
+
+/* Returns the offset after the line starting at off */
+
+static size_t
+wordlist_eol(struct wordlist *wl, size_t off)
+{
+	u_char *p;
+
+	p = memchr(wl->data + off, '\n', wl->size - off);
+	return (p == NULL ? wl->size : p - wl->data + 1);
+}
+
+static int
+wordlist_iscomment(struct wordlist *wl, size_t off)
+{
+	return (wl->data[off] == '#' &&
+	    wl->size - off >= sizeof(COMMENT) - 1 &&
+	    !memcmp(wl->data + off, COMMENT, sizeof(COMMENT) - 1));
+}
+
+static void
+wordlist_index(struct wordlist *wl)
+{
+	size_t off, nindex = 0, maxindex = 1024;
+
+	if ((wl->index = malloc(maxindex * sizeof(size_t))) == NULL)
+		err(1, "malloc");
+
+	wl->nwords = 0;
+	for (off = 0; off < wl->size; off = wordlist_eol(wl, off)) {
+		if (wordlist_iscomment(wl, off))
+			continue;
+
+		if (wl->nwords % WORDLIST_STRIDE == 0) {
+			if (nindex == maxindex) {
+				maxindex <<= 1;
+				wl->index = realloc(wl->index,
+				    maxindex * sizeof(size_t));
+				if (wl->index == NULL)
+					err(1, "realloc");
+			}
+			wl->index[nindex++] = off;
+		}
+		wl->nwords++;
+	}
+}
+
+/* A name of NULL or "-" reads the words from stdin */
+
+struct wordlist *
+wordlist_open(char *name)
+{
+	struct wordlist *wl;
+	struct stat sb;
+	int fd;
+
+	if ((wl = calloc(1, sizeof(struct wordlist))) == NULL)
+		err(1, "calloc");
+
+	if (name == NULL || !strcmp(name, "-")) {
+		wl->name = strdup("stdin");
+		fd = STDIN_FILENO;
+	} else {
+		wl->name = strdup(name);
+		if ((fd = open(name, O_RDONLY, 0)) == -1)
+			err(1, "open: %s", name);
+	}
+	if (wl->name == NULL)
+		err(1, "strdup");
+
+	if (fstat(fd, &sb) == -1)
+		err(1, "fstat: %s", wl->name);
+
+	if (S_ISREG(sb.st_mode) && sb.st_size > 0 &&
+	    sb.st_size == (size_t)sb.st_size) {
+		wl->size = sb.st_size;
+		wl->data = mmap(NULL, wl->size, PROT_READ, MAP_PRIVATE,
+		    fd, 0);
+		if (wl->data != MAP_FAILED) {
+			wl->mapped = 1;
+#ifdef MADV_SEQUENTIAL
+			madvise(wl->data, wl->size, MADV_SEQUENTIAL);
+#endif
+		}
+	}
+
+	if (!wl->mapped && wordlist_read(wl, fd) == -1)
+		err(1, "read: %s", wl->name);
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	wordlist_index(wl);
+
+	return (wl);
+}
+
+void
+wordlist_close(struct wordlist *wl)
+{
+	if (wl->mapped)
+		munmap(wl->data, wl->size);
+	else
+		free(wl->data);
+	free(wl->index);
+	free(wl->name);
+	free(wl);
+}
+
+void
+wordlist_seek(struct wordlist *wl, struct wordpos *pos, size_t word)
+{
+	if (word >= wl->nwords) {
+		pos->word = wl->nwords;
+		pos->off = wl->size;
+		return;
+	}
+
+	pos->word = word - word % WORDLIST_STRIDE;
+	pos->off = wl->index[word / WORDLIST_STRIDE];
+
+	while (pos->word < word) {
+		pos->off = wordlist_eol(wl, pos->off);
+		if (!wordlist_iscomment(wl, pos->off))
+			pos->word++;
+	}
+}
+
+/*
+ * Copies the next word into line, like fgetl: the line ending is
+ * removed and long lines are truncated.  Returns 0 at the end.
+ */
+
+int
+wordlist_next(struct wordlist *wl, struct wordpos *pos, char *line,
+    size_t size)
+{
+	size_t off, eol, len;
+
+	off = pos->off;
+	while (off < wl->size && wordlist_iscomment(wl, off))
+		off = wordlist_eol(wl, off);
+	if (off >= wl->size)
+		return (0);
+
+	eol = wordlist_eol(wl, off);
+	len = eol - off;
+	if (len && wl->data[off + len - 1] == '\n')
+		len--;
+	if (len && wl->data[off + len - 1] == '\r')
+		len--;
+	if (len >= size)
+		len = size - 1;
+
+	memcpy(line, wl->data + off, len);
+	line[len] = '\0';
+
+	pos->off = eol;
+	pos->word++;
+
+	return (1);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2001 Niels Provos <provos@citi.umich.edu>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *      This product includes software developed by Niels Provos.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _WORDLIST_H_
+#define _WORDLIST_H_
+
+#define WORDLIST_STRIDE	64	/* Words between two index entries */
+
+/*
+ * A wordlist that is mapped into memory once.  Comment lines are left
+ * out of the word numbering, and the offset of every WORDLIST_STRIDE'th
+ * word is kept, so that a pass can start at any word.
+ */
+struct wordlist {
+	char *name;
+	u_char *data;
+	size_t size;
+	int mapped;
+
+	size_t nwords;
+	size_t *index;
+};
+
+/* Position of a pass through the wordlist */
+struct wordpos {
+	size_t word;		/* Number of the next word */
+	size_t off;		/* Its offset in the data */
+};
+
+struct wordlist *wordlist_open(char *);
+void wordlist_close(struct wordlist *);
+void wordlist_seek(struct wordlist *, struct wordpos *, size_t);
+int wordlist_next(struct wordlist *, struct wordpos *, char *, size_t);
+
+#endif /* _WORDLIST_H_ */